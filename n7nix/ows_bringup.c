@@ -0,0 +1,381 @@
+/*
+ * Bring up the One Watt Spot at boot
+ *  - replaces ows_gpio_setup.sh, ows_alsa_setup.sh & ows_init
+ *  - gpio lines, mixer profile & DRA818V configuration are done
+ *    in parallel, the module handshake only waits for the Activate line
+ *  - prints a timing breakdown of each phase
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include "ows_serialio.h"
+#include "ows_module.h"
+#include "ows_gpio.h"
+#include "ows_mixer.h"
+
+#define PROG_VERSION "1.0"
+/* Links to: /dev/ttyAMA0 on RPi 2, /dev/ttyS0 on RPi 3 */
+#define RPI_SERIAL_DEVICE "/dev/serial0"
+#define SIZE_READBUF 128
+#define SIZE_ATBUF 128
+#define DEFAULT_FREQ 1443900 /* APRS 2M 1200 baud */
+#define BRINGUP_READ_TIMEOUT 1000 /* msec, module answers in well under this */
+
+static void usage(void);
+const char *getprogname(void);
+
+/* Bring up phases, times in msec from program start */
+enum { PHASE_GPIO, PHASE_MIXER, PHASE_HANDSHAKE, PHASE_CONFIG, PHASE_COUNT };
+
+typedef struct phase {
+	const char *name;
+	double start_ms;
+	double end_ms;
+	int status;	/* 0 ok, -1 failed */
+} phase_t;
+
+static phase_t phase[PHASE_COUNT] = {
+	{ "gpio" }, { "mixer" }, { "handshake" }, { "configure" }
+};
+
+static double start_ms;
+static gsc_t gsc;
+static int dra_volume;
+static char *serial_device = RPI_SERIAL_DEVICE;
+static char *mixer_card = OWS_MIXER_CARD;
+static char *mixer_profile = OWS_MIXER_PROFILE;
+
+/* Activate line has been set, module may be talked to */
+static pthread_mutex_t gpio_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gpio_cond = PTHREAD_COND_INITIALIZER;
+static bool gpio_done;
+
+int DebugFlag = false;
+int gverbose_flag = false;
+
+extern char *__progname;
+
+static void phase_begin(int idx)
+{
+	phase[idx].start_ms = ows_module_now_ms() - start_ms;
+}
+
+static void phase_end(int idx, int status)
+{
+	phase[idx].end_ms = ows_module_now_ms() - start_ms;
+	phase[idx].status = status;
+}
+
+/*
+ * Same lines as ows_gpio_setup.sh
+ *  - outputs are kept after exit by ows_gpio_keep
+ */
+static void *gpio_thread(void *arg)
+{
+	int status = 0;
+
+	phase_begin(PHASE_GPIO);
+	if (ows_gpio_open() < 0 ||
+	    ows_gpio_output(OWS_GPIO_PTT, 1) < 0 ||
+	    ows_gpio_output(OWS_GPIO_ACTIVATE, 1) < 0 ||
+	    ows_gpio_output(OWS_GPIO_HIPOWER, 0) < 0 ||
+	    ows_gpio_input(OWS_GPIO_INPUT) < 0) {
+		status = -1;
+	}
+	phase_end(PHASE_GPIO, status);
+
+	pthread_mutex_lock(&gpio_lock);
+	gpio_done = true;
+	pthread_cond_broadcast(&gpio_cond);
+	pthread_mutex_unlock(&gpio_lock);
+
+	return(NULL);
+}
+
+static void *mixer_thread(void *arg)
+{
+	int count;
+
+	phase_begin(PHASE_MIXER);
+	count = ows_mixer_apply(mixer_card, mixer_profile);
+	if (count == 0) {
+		printf("%s: no controls in %s\n", __FUNCTION__, mixer_profile);
+	}
+	/* an empty profile or a control not set is a failed phase */
+	phase_end(PHASE_MIXER, count <= 0 ? -1 : 0);
+
+	return(NULL);
+}
+
+static void *dra_thread(void *arg)
+{
+	char readbuf[SIZE_READBUF];
+	char atbuf[SIZE_ATBUF];
+	int uart0fs, status = 0;
+
+	/* open serial port while gpio is being set up */
+	uart0fs = ows_initserial(serial_device);
+	ows_setreadtimeout(BRINGUP_READ_TIMEOUT);
+
+	pthread_mutex_lock(&gpio_lock);
+	while (!gpio_done) {
+		pthread_cond_wait(&gpio_cond, &gpio_lock);
+	}
+	pthread_mutex_unlock(&gpio_lock);
+
+	phase_begin(PHASE_HANDSHAKE);
+	if (uart0fs < 0 || ows_module_handshake(uart0fs, WD_READY_TRIES) <= 0) {
+		phase_end(PHASE_HANDSHAKE, -1);
+		if (uart0fs >= 0) {
+			close(uart0fs);
+		}
+		return(NULL);
+	}
+	phase_end(PHASE_HANDSHAKE, 0);
+
+	phase_begin(PHASE_CONFIG);
+	snprintf(atbuf, sizeof(atbuf), "AT+DMOSETGROUP=%d,%s,%s,%04d,%d,%04d",
+		 gsc.gbw,gsc.tfv, gsc.rfv, gsc.tx_ctcss, gsc.sq, gsc.rx_ctcss);
+	if (ows_module_command(uart0fs, atbuf, readbuf, sizeof(readbuf)) > 0) {
+		ows_state_cache(atbuf);
+	} else {
+		status = -1;
+	}
+	snprintf(atbuf, sizeof(atbuf), "AT+SETFILTER=1,1,1");
+	if (ows_module_command(uart0fs, atbuf, readbuf, sizeof(readbuf)) > 0) {
+		ows_state_cache(atbuf);
+	} else {
+		status = -1;
+	}
+	snprintf(atbuf, sizeof(atbuf), "AT+DMOSETVOLUME=%d", dra_volume);
+	if (ows_module_command(uart0fs, atbuf, readbuf, sizeof(readbuf)) > 0) {
+		ows_state_cache(atbuf);
+	} else {
+		status = -1;
+	}
+	/* cached configuration for ows_scan watchdog */
+	ows_state_save(OWS_STATE_FILE);
+	phase_end(PHASE_CONFIG, status);
+
+	close(uart0fs);
+	return(NULL);
+}
+
+/* Seconds since boot, -1 if unknown */
+static double uptime_sec(void)
+{
+	FILE *fp;
+	double uptime = -1.0;
+
+	fp = fopen("/proc/uptime", "r");
+	if (fp != NULL) {
+		if (fscanf(fp, "%lf", &uptime) != 1) {
+			uptime = -1.0;
+		}
+		fclose(fp);
+	}
+	return(uptime);
+}
+
+int main(int argc, char *argv[])
+{
+	/* For command line parsing */
+	int next_option;
+	int option_index = 0; /* getopt_long stores the option index here. */
+
+	pthread_t gpio_tid, mixer_tid, dra_tid;
+	char *ptx_freq, *prx_freq;
+	long int itx_freq, irx_freq;
+	double total_ms;
+	int i, retcode = EXIT_SUCCESS;
+
+	/* short options */
+	static const char *short_options = "hVds:v:D:m:c:";
+	/* long options */
+	static struct option long_options[] =
+	{
+		/* These options set a flag. */
+		{"verbose",       no_argument,  &gverbose_flag, true},
+		{"debug",         no_argument,  &DebugFlag, true},
+		/* These options don't set a flag.
+		We distinguish them by their indices. */
+		{"help",          no_argument,       NULL, 'h'},
+		{"volume",        required_argument, NULL, 'v'},
+		{"squelch",       required_argument, NULL, 's'},
+		{"device",        required_argument, NULL, 'D'},
+		{"mixer",         required_argument, NULL, 'm'},
+		{"card",          required_argument, NULL, 'c'},
+		{NULL, no_argument, NULL, 0} /* array termination */
+	};
+
+	start_ms = ows_module_now_ms();
+
+	/* init some variables, same defaults as ows_init */
+	memset(&gsc, 0, sizeof(gsc));
+	gsc.sq = 4;
+	gsc.gbw = 1; /* set bandwidth to 25Khz */
+	dra_volume = 3;
+	itx_freq = irx_freq = DEFAULT_FREQ;
+	snprintf(gsc.tfv, DORJI_SIG_DIG+1, "%ld", itx_freq);
+	snprintf(gsc.rfv, DORJI_SIG_DIG+1, "%ld", irx_freq);
+	add_decimal(gsc.tfv);
+	add_decimal(gsc.rfv);
+
+	opterr = 0;
+	option_index = 0;
+	next_option = getopt_long (argc, argv, short_options,
+				   long_options, &option_index);
+
+	while( next_option != -1 ) {
+
+		switch (next_option) {
+			case 0:   /* long option without a short arg */
+				break;
+			case 'v': /* set volume */
+				dra_volume = atoi(optarg);
+				if (!check_volume(dra_volume)) {
+					printf("%s: Volume out of range: %d\n", getprogname(), dra_volume);
+					usage(); /* does not return */
+				}
+				break;
+			case 's':   /* set squelch */
+				gsc.sq = atoi(optarg);
+				if (!check_squelch(gsc.sq)) {
+					printf("%s: Squelch out of range: %d\n", getprogname(), gsc.sq);
+					usage(); /* does not return */
+				}
+				break;
+			case 'D':   /* serial device */
+				serial_device = optarg;
+				break;
+			case 'm':   /* mixer profile */
+				mixer_profile = optarg;
+				break;
+			case 'c':   /* sound card */
+				mixer_card = optarg;
+				break;
+			case 'V':   /* set verbose flag */
+				gverbose_flag = true;
+				break;
+			case 'd':
+				DebugFlag = true;
+				break;
+			case 'h':
+				usage();  /* does not return */
+				break;
+			case '?':
+				if (isprint (optopt)) {
+					fprintf (stderr, "%s: Unknown option `-%c'.\n",
+						getprogname(), optopt);
+				} else {
+					fprintf (stderr,"%s: Unknown option character `\\x%x'.\n",
+						getprogname(), optopt);
+				}
+				/* fall through */
+			default:
+				usage();  /* does not return */
+				break;
+		}
+
+		next_option = getopt_long (argc, argv, short_options,
+					   long_options, &option_index);
+	}
+
+	/* [tx freq] [rx freq], no decimal points */
+	if(optind < argc) {
+		ptx_freq = argv[optind++];
+		if( memchr(ptx_freq, '.', strlen(ptx_freq)) != NULL) {
+			usage(); /* does not return */
+		}
+		padrightzeros(ptx_freq, gsc.tfv);
+		itx_freq = strtol(gsc.tfv, NULL, 0);
+		add_decimal(gsc.tfv);
+
+		/* make receive frequency the same */
+		strcpy(gsc.rfv, gsc.tfv);
+		irx_freq = itx_freq;
+	}
+	if(optind < argc) {
+		prx_freq = argv[optind++];
+		if( memchr(prx_freq, '.', strlen(prx_freq)) != NULL) {
+			usage(); /* does not return */
+		}
+		padrightzeros(prx_freq, gsc.rfv);
+		irx_freq = strtol(gsc.rfv, NULL, 0);
+		add_decimal(gsc.rfv);
+	}
+	if( optind < argc || !check_freq(itx_freq) || !check_freq(irx_freq)) {
+		printf("%s: Frequency out of range: %ld %ld\n",
+		       getprogname(), itx_freq, irx_freq);
+		usage();  /* does not return */
+	}
+
+	/* a missing amixer must not kill us */
+	signal(SIGPIPE, SIG_IGN);
+
+	pthread_create(&gpio_tid, NULL, gpio_thread, NULL);
+	pthread_create(&mixer_tid, NULL, mixer_thread, NULL);
+	pthread_create(&dra_tid, NULL, dra_thread, NULL);
+	pthread_join(gpio_tid, NULL);
+	pthread_join(mixer_tid, NULL);
+	pthread_join(dra_tid, NULL);
+	total_ms = ows_module_now_ms() - start_ms;
+
+	printf("phase       start(ms)    end(ms)  elapsed(ms)  status\n");
+	for (i = 0; i < PHASE_COUNT; i++) {
+		if (phase[i].end_ms == 0.0) {
+			printf("%-10s  %9s  %9s  %11s  skipped\n", phase[i].name, "-", "-", "-");
+			retcode = EXIT_FAILURE;
+			continue;
+		}
+		printf("%-10s  %9.1f  %9.1f  %11.1f  %s\n", phase[i].name,
+		       phase[i].start_ms, phase[i].end_ms,
+		       phase[i].end_ms - phase[i].start_ms,
+		       phase[i].status == 0 ? "ok" : "FAILED");
+		if (phase[i].status != 0) {
+			retcode = EXIT_FAILURE;
+		}
+	}
+	printf("Total: %.1f ms, system uptime at ready: %.2f sec\n",
+	       total_ms, uptime_sec());
+
+	/* PTT & Activate must not float once we exit */
+	if (ows_gpio_keep() < 0) {
+		retcode = EXIT_FAILURE;
+	}
+	return(retcode);
+}
+
+const char *getprogname(void)
+{
+	return __progname;
+}
+
+/*
+ * Print usage information and exit
+ *  - does not return
+ */
+static void usage(void)
+{
+	printf("Usage:  %s [options] [tx freq] [rx freq]\n", getprogname());
+	printf("  Version: %s\n", PROG_VERSION);
+	printf("  frequency range: 1340000 to 1740000\n");
+	printf("  No decimal points used in freq\n");
+	printf("  -v  --volume     Set volume of module (1-8)\n");
+	printf("  -s  --squelch    Set squelch level (0-8)\n");
+	printf("  -D  --device     Serial device (%s)\n", RPI_SERIAL_DEVICE);
+	printf("  -m  --mixer      Mixer profile (%s)\n", OWS_MIXER_PROFILE);
+	printf("  -c  --card       Sound card (%s)\n", OWS_MIXER_CARD);
+	printf("  -V  --verbose    Print verbose messages\n");
+	printf("  -d  --debug      Turn on debug messages\n");
+	printf("  -h  --help       Display this usage info\n");
+
+	exit(EXIT_SUCCESS);
+}
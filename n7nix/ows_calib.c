@@ -0,0 +1,684 @@
+/*
+ * Audio level calibration for the One Watt Spot
+ *  - streams receive audio from a WAV file, or the UDRC when built
+ *    with ALSA, through a level meter & an averaged FFT
+ *  - rx: sets ADC Level for the requested peak headroom on AFOUT
+ *  - tx: measures deviation of a received test tone on DISCOUT &
+ *    searches PCM & LO Driver Gain for the target deviation
+ *  - writes a mixer profile for ows_bringup
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+#include "ows_mixer.h"
+#include "ows_wav.h"
+
+#define PROG_VERSION "1.0"
+#define FFT_SIZE 2048		/* power of 2 */
+#define FFT_LOG2 11
+#define TONE_MIN_HZ 300.0
+#define TONE_MAX_HZ 3000.0
+#define TONE_MIN_SNR_DB 20.0	/* tone peak bin over the mean of the band */
+#define CLIP_LEVEL 0.999	/* peak at 0 dBFS, capture clipped */
+
+/* TLV320AIC3104 control ranges & steps, see amixer -c udrc */
+#define ADC_MIN_DB  -12.0
+#define ADC_MAX_DB   20.0
+#define ADC_STEP_DB   0.5
+#define PCM_MIN_DB  -63.5
+#define PCM_MAX_DB    0.0	/* no digital gain, would clip */
+#define PCM_STEP_DB   0.5
+#define LO_MIN_DB    -6.0
+#define LO_MAX_DB    29.0
+#define LO_STEP_DB    1.0
+
+#define DEFAULT_HEADROOM_DB 6.0
+#define DEFAULT_DEVIATION_HZ 2800.0
+/* Discriminator output at full scale, measure once with a signal generator */
+#define DEFAULT_DISC_HZ_FS 7500.0
+#define DEFAULT_CAPTURE_SEC 5
+#define SAMPLE_RATE 48000
+
+#define CHAN_AFOUT 0	/* left, receive audio */
+#define CHAN_DISCOUT 1	/* right, discriminator */
+
+static void usage(void);
+const char *getprogname(void);
+
+int DebugFlag = false;
+int gverbose_flag = false;
+
+extern char *__progname;
+
+/* Streaming analysis state, split real & imaginary for vectorizing */
+typedef struct analyzer {
+	float window[FFT_SIZE];
+	float tw_re[FFT_SIZE];	/* twiddles, stage of half size h at [h, 2h) */
+	float tw_im[FFT_SIZE];
+	uint16_t bitrev[FFT_SIZE];
+	float re[FFT_SIZE];
+	float im[FFT_SIZE];
+	double power[FFT_SIZE / 2];	/* summed power spectrum */
+	float block[FFT_SIZE];
+	int fill;
+	int nblocks;
+	double sumsq;
+	float peak;
+	unsigned long nsamples;
+	int rate;
+} analyzer_t;
+
+static void analyzer_init(analyzer_t *pa, int rate)
+{
+	int i, j, h;
+
+	memset(pa, 0, sizeof(*pa));
+	pa->rate = rate;
+	for (i = 0; i < FFT_SIZE; i++) {
+		/* Hann window */
+		pa->window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / FFT_SIZE);
+		for (j = 0, h = i; j < FFT_LOG2; j++, h >>= 1) {
+			pa->bitrev[i] = (pa->bitrev[i] << 1) | (h & 1);
+		}
+	}
+	for (h = 1; h < FFT_SIZE; h <<= 1) {
+		for (j = 0; j < h; j++) {
+			pa->tw_re[h + j] = cos(-M_PI * j / h);
+			pa->tw_im[h + j] = sin(-M_PI * j / h);
+		}
+	}
+}
+
+/*
+ * In place radix 2 FFT, bit reversed load then butterflies
+ *  - inner loop is unit stride with no aliasing so gcc vectorizes it
+ */
+static void fft(analyzer_t *pa)
+{
+	float *restrict re = pa->re;
+	float *restrict im = pa->im;
+	int h, k, j;
+
+	for (h = 1; h < FFT_SIZE; h <<= 1) {
+		const float *restrict wr = &pa->tw_re[h];
+		const float *restrict wi = &pa->tw_im[h];
+
+		for (k = 0; k < FFT_SIZE; k += 2 * h) {
+			float *restrict ar = &re[k], *restrict ai = &im[k];
+			float *restrict br = &re[k + h], *restrict bi = &im[k + h];
+
+			for (j = 0; j < h; j++) {
+				float tr = br[j] * wr[j] - bi[j] * wi[j];
+				float ti = br[j] * wi[j] + bi[j] * wr[j];
+
+				br[j] = ar[j] - tr;
+				bi[j] = ai[j] - ti;
+				ar[j] = ar[j] + tr;
+				ai[j] = ai[j] + ti;
+			}
+		}
+	}
+}
+
+static void analyzer_block(analyzer_t *pa)
+{
+	int i;
+
+	for (i = 0; i < FFT_SIZE; i++) {
+		pa->re[i] = pa->block[pa->bitrev[i]] * pa->window[pa->bitrev[i]];
+		pa->im[i] = 0.0f;
+	}
+	fft(pa);
+	for (i = 0; i < FFT_SIZE / 2; i++) {
+		pa->power[i] += pa->re[i] * pa->re[i] + pa->im[i] * pa->im[i];
+	}
+	pa->nblocks++;
+}
+
+/* Feed samples, full scale is 1.0 */
+static void analyzer_feed(analyzer_t *pa, const float *samples, int count)
+{
+	double sumsq = 0.0;
+	float peak = pa->peak;
+	int i, n;
+
+	/* level meter */
+	for (i = 0; i < count; i++) {
+		float a = fabsf(samples[i]);
+
+		sumsq += samples[i] * samples[i];
+		peak = a > peak ? a : peak;
+	}
+	pa->sumsq += sumsq;
+	pa->peak = peak;
+	pa->nsamples += count;
+
+	while (count > 0) {
+		n = FFT_SIZE - pa->fill;
+		if (n > count) {
+			n = count;
+		}
+		memcpy(&pa->block[pa->fill], samples, n * sizeof(float));
+		pa->fill += n;
+		samples += n;
+		count -= n;
+		if (pa->fill == FFT_SIZE) {
+			analyzer_block(pa);
+			pa->fill = 0;
+		}
+	}
+}
+
+static double db(double ratio)
+{
+	return(ratio > 0.0 ? 20.0 * log10(ratio) : -200.0);
+}
+
+/*
+ * Strongest tone between TONE_MIN_HZ & TONE_MAX_HZ
+ *  - psnr_db gets the tone peak bin over the mean power of the rest
+ *    of the band
+ *  returns tone peak amplitude, full scale is 1.0
+ */
+static double analyzer_tone(analyzer_t *pa, double *pfreq, double *psnr_db)
+{
+	int lo = TONE_MIN_HZ * FFT_SIZE / pa->rate;
+	int hi = TONE_MAX_HZ * FFT_SIZE / pa->rate;
+	double sum = 0.0, noise = 0.0, a, b, c, offset;
+	int i, best = lo, nbins = 0;
+
+	*pfreq = 0.0;
+	*psnr_db = 0.0;
+	if (pa->nblocks == 0) {
+		return(0.0);
+	}
+	/* leave room for the main lobe below Nyquist */
+	if (hi > FFT_SIZE / 2 - 3) {
+		hi = FFT_SIZE / 2 - 3;
+	}
+	for (i = lo; i <= hi; i++) {
+		if (pa->power[i] > pa->power[best]) {
+			best = i;
+		}
+	}
+	for (i = lo; i <= hi; i++) {
+		if (i < best - 3 || i > best + 3) {
+			noise += pa->power[i];
+			nbins++;
+		}
+	}
+	if (pa->power[best] <= 0.0) {
+		return(0.0);
+	}
+	*psnr_db = 10.0 * log10(pa->power[best] * (nbins ? nbins : 1) / (noise + 1e-30));
+
+	/* parabolic interpolation on log magnitude */
+	a = log(pa->power[best - 1] + 1e-20);
+	b = log(pa->power[best] + 1e-20);
+	c = log(pa->power[best + 1] + 1e-20);
+	offset = a - 2.0 * b + c != 0.0 ? 0.5 * (a - c) / (a - 2.0 * b + c) : 0.0;
+	*pfreq = (best + offset) * pa->rate / FFT_SIZE;
+
+	/* sum window main lobe, one sided Hann power is 3/32 (N A)^2 */
+	for (i = best - 2; i <= best + 2; i++) {
+		sum += pa->power[i];
+	}
+	sum /= pa->nblocks;
+	return(sqrt(sum * 32.0 / 3.0) / FFT_SIZE);
+}
+
+/* Read up to maxframes of one channel, returns frames read */
+static int wav_read(ows_wav_t *pwav, int chan, float *out, int maxframes)
+{
+	int16_t frames[FFT_SIZE * 8];
+	int nframes, i;
+
+	if (maxframes * pwav->channels > (int)(sizeof(frames) / sizeof(int16_t))) {
+		maxframes = sizeof(frames) / sizeof(int16_t) / pwav->channels;
+	}
+	nframes = ows_wav_read(pwav, frames, maxframes);
+
+	if (chan >= pwav->channels) {
+		chan = pwav->channels - 1;
+	}
+	for (i = 0; i < nframes; i++) {
+		out[i] = frames[i * pwav->channels + chan] / 32768.0f;
+	}
+	return(nframes);
+}
+
+static int analyze_wav(const char *pathname, int chan, analyzer_t *pa)
+{
+	ows_wav_t wav;
+	float samples[FFT_SIZE];
+	int n;
+
+	if (ows_wav_open(pathname, &wav) < 0) {
+		return(-1);
+	}
+	analyzer_init(pa, wav.rate);
+	while ((n = wav_read(&wav, chan, samples, FFT_SIZE)) > 0) {
+		analyzer_feed(pa, samples, n);
+	}
+	ows_wav_close(&wav);
+	return(0);
+}
+
+#ifdef HAVE_ALSA
+static int analyze_capture(const char *device, int chan, int seconds, analyzer_t *pa)
+{
+	snd_pcm_t *pcm;
+	int16_t frames[FFT_SIZE * 2];
+	float samples[FFT_SIZE];
+	long total = (long)seconds * SAMPLE_RATE;
+	snd_pcm_sframes_t n;
+	int err, i;
+
+	if ((err = snd_pcm_open(&pcm, device, SND_PCM_STREAM_CAPTURE, 0)) < 0 ||
+	    (err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE,
+				      SND_PCM_ACCESS_RW_INTERLEAVED, 2,
+				      SAMPLE_RATE, 1, 100000)) < 0) {
+		printf("%s: %s: %s\n", __FUNCTION__, device, snd_strerror(err));
+		return(-1);
+	}
+	analyzer_init(pa, SAMPLE_RATE);
+	while (total > 0) {
+		n = snd_pcm_readi(pcm, frames, FFT_SIZE);
+		if (n < 0) {
+			n = snd_pcm_recover(pcm, n, 0);
+			if (n < 0) {
+				break;
+			}
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+			samples[i] = frames[i * 2 + chan] / 32768.0f;
+		}
+		analyzer_feed(pa, samples, n);
+		total -= n;
+	}
+	snd_pcm_close(pcm);
+	return(0);
+}
+#endif /* HAVE_ALSA */
+
+static double quantize(double value, double step, double min, double max)
+{
+	value = round(value / step) * step;
+	return(value < min ? min : value > max ? max : value);
+}
+
+/*
+ * Search LO Driver Gain & PCM for a change of gain_db in tx level
+ *  - smallest error wins, ties go to PCM closest to 0 dB for best SNR
+ *  returns remaining error in dB
+ */
+static double search_tx(double gain_db, double *pcm_db, double *lo_db)
+{
+	double target = *pcm_db + *lo_db + gain_db;
+	double lo, pcm, err, best_err = 1e9;
+	double best_pcm = *pcm_db, best_lo = *lo_db;
+
+	for (lo = LO_MIN_DB; lo <= LO_MAX_DB; lo += LO_STEP_DB) {
+		pcm = quantize(target - lo, PCM_STEP_DB, PCM_MIN_DB, PCM_MAX_DB);
+		err = fabs(lo + pcm - target);
+		if (err < best_err - 0.01 ||
+		    (err < best_err + 0.01 && fabs(pcm) < fabs(best_pcm))) {
+			best_err = err;
+			best_pcm = pcm;
+			best_lo = lo;
+		}
+	}
+	*pcm_db = best_pcm;
+	*lo_db = best_lo;
+	return(best_err);
+}
+
+/* Copy base profile with level controls replaced */
+static int write_profile(const char *base, const char *out, const char *note,
+			 double adc_db, double pcm_db, double lo_db, bool rx, bool tx)
+{
+	ows_mixer_set_t mset;
+	char line[256], tmpname[256];
+	FILE *fin, *fout;
+	int retcode = 0;
+
+	fin = fopen(base, "r");
+	if (fin == NULL) {
+		perror(base);
+		return(-1);
+	}
+	/* out may be the base profile, replace it only once written */
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp", out);
+	fout = strcmp(out, "-") == 0 ? stdout : fopen(tmpname, "w");
+	if (fout == NULL) {
+		perror(tmpname);
+		fclose(fin);
+		return(-1);
+	}
+	fprintf(fout, "# %s\n", note);
+	while (fgets(line, sizeof(line), fin) != NULL) {
+		/* drop note from a previous calibration */
+		if (strncmp(line, "# ows_calib", 11) == 0) {
+			continue;
+		}
+		if (ows_mixer_parse(line, &mset) > 0) {
+			if (rx && strcmp(mset.name, "ADC Level") == 0) {
+				fprintf(fout, "sset 'ADC Level' %.1fdB\n", adc_db);
+				continue;
+			}
+			if (tx && strcmp(mset.name, "PCM") == 0) {
+				fprintf(fout, "sset 'PCM' %.1fdB\n", pcm_db);
+				continue;
+			}
+			if (tx && strcmp(mset.name, "LO Driver Gain") == 0) {
+				fprintf(fout, "sset 'LO Driver Gain' %.1fdB\n", lo_db);
+				continue;
+			}
+		}
+		fputs(line, fout);
+	}
+	fclose(fin);
+	if (fout == stdout) {
+		return(0);
+	}
+	if (fclose(fout) != 0 || rename(tmpname, out) < 0) {
+		perror(out);
+		unlink(tmpname);
+		retcode = -1;
+	}
+	return(retcode);
+}
+
+/* Test file: tone on both channels at level dBFS with a little noise */
+static int generate_wav(const char *pathname, double level_dbfs, double tone_hz, int seconds)
+{
+	FILE *fp;
+	uint32_t nframes = seconds * SAMPLE_RATE, u32;
+	uint16_t u16;
+	int16_t frame[2];
+	double amp = pow(10.0, level_dbfs / 20.0), v;
+	uint32_t i;
+
+	fp = fopen(pathname, "wb");
+	if (fp == NULL) {
+		perror(pathname);
+		return(-1);
+	}
+	fwrite("RIFF", 4, 1, fp);
+	u32 = 36 + nframes * 4; fwrite(&u32, 4, 1, fp);
+	fwrite("WAVEfmt ", 8, 1, fp);
+	u32 = 16; fwrite(&u32, 4, 1, fp);
+	u16 = 1; fwrite(&u16, 2, 1, fp);
+	u16 = 2; fwrite(&u16, 2, 1, fp);
+	u32 = SAMPLE_RATE; fwrite(&u32, 4, 1, fp);
+	u32 = SAMPLE_RATE * 4; fwrite(&u32, 4, 1, fp);
+	u16 = 4; fwrite(&u16, 2, 1, fp);
+	u16 = 16; fwrite(&u16, 2, 1, fp);
+	fwrite("data", 4, 1, fp);
+	u32 = nframes * 4; fwrite(&u32, 4, 1, fp);
+
+	srand(1);
+	for (i = 0; i < nframes; i++) {
+		v = amp * sin(2.0 * M_PI * tone_hz * i / SAMPLE_RATE) +
+		    0.001 * ((double)rand() / RAND_MAX - 0.5);
+		frame[0] = frame[1] = (int16_t)lrint(v * 32767.0);
+		fwrite(frame, sizeof(frame), 1, fp);
+	}
+	fclose(fp);
+	printf("Wrote %d sec %.0f Hz tone at %.1f dBFS to %s\n",
+	       seconds, tone_hz, level_dbfs, pathname);
+	return(0);
+}
+
+int main(int argc, char *argv[])
+{
+	/* For command line parsing */
+	int next_option;
+	int option_index = 0; /* getopt_long stores the option index here. */
+
+	char *wav_file = NULL, *gen_file = NULL;
+	char *capture_device = "plughw:CARD=udrc";
+	char *base_profile = OWS_MIXER_PROFILE, *out_profile = "-";
+	bool do_rx = false, do_tx = false;
+	double headroom_db = DEFAULT_HEADROOM_DB;
+	double deviation_hz = DEFAULT_DEVIATION_HZ;
+	double disc_hz_fs = DEFAULT_DISC_HZ_FS;
+	double adc_db = -1.0, pcm_db = 0.0, lo_db = 5.0;
+	double expect = NAN, gen_level = -12.0;
+	int capture_sec = DEFAULT_CAPTURE_SEC;
+	analyzer_t *pa;
+	struct timespec t0, t1;
+	double elapsed, rms_db, peak_db, tone_amp, tone_hz, tone_snr, err_db;
+	char note[160];
+	int chan;
+
+	/* short options */
+	static const char *short_options = "hVdrtf:a:s:m:o:H:D:k:A:P:L:e:G:l:";
+	/* long options */
+	static struct option long_options[] =
+	{
+		/* These options set a flag. */
+		{"verbose",     no_argument,  &gverbose_flag, true},
+		{"debug",       no_argument,  &DebugFlag, true},
+		/* These options don't set a flag.
+		We distinguish them by their indices. */
+		{"help",        no_argument,       NULL, 'h'},
+		{"rx",          no_argument,       NULL, 'r'},
+		{"tx",          no_argument,       NULL, 't'},
+		{"file",        required_argument, NULL, 'f'},
+		{"capture",     required_argument, NULL, 'a'},
+		{"seconds",     required_argument, NULL, 's'},
+		{"mixer",       required_argument, NULL, 'm'},
+		{"output",      required_argument, NULL, 'o'},
+		{"headroom",    required_argument, NULL, 'H'},
+		{"deviation",   required_argument, NULL, 'D'},
+		{"disc",        required_argument, NULL, 'k'},
+		{"adc",         required_argument, NULL, 'A'},
+		{"pcm",         required_argument, NULL, 'P'},
+		{"lo",          required_argument, NULL, 'L'},
+		{"expect",      required_argument, NULL, 'e'},
+		{"generate",    required_argument, NULL, 'G'},
+		{"level",       required_argument, NULL, 'l'},
+		{NULL, no_argument, NULL, 0} /* array termination */
+	};
+
+	opterr = 0;
+	option_index = 0;
+	next_option = getopt_long (argc, argv, short_options,
+				   long_options, &option_index);
+
+	while( next_option != -1 ) {
+
+		switch (next_option) {
+			case 0:   /* long option without a short arg */
+				break;
+			case 'r': do_rx = true; break;
+			case 't': do_tx = true; break;
+			case 'f': wav_file = optarg; break;
+			case 'a': capture_device = optarg; break;
+			case 's': capture_sec = atoi(optarg); break;
+			case 'm': base_profile = optarg; break;
+			case 'o': out_profile = optarg; break;
+			case 'H': headroom_db = atof(optarg); break;
+			case 'D': deviation_hz = atof(optarg); break;
+			case 'k': disc_hz_fs = atof(optarg); break;
+			case 'A': adc_db = atof(optarg); break;
+			case 'P': pcm_db = atof(optarg); break;
+			case 'L': lo_db = atof(optarg); break;
+			case 'e': expect = atof(optarg); break;
+			case 'G': gen_file = optarg; break;
+			case 'l': gen_level = atof(optarg); break;
+			case 'V':   /* set verbose flag */
+				gverbose_flag = true;
+				break;
+			case 'd':
+				DebugFlag = true;
+				break;
+			case 'h':
+				usage();  /* does not return */
+				break;
+			case '?':
+				if (isprint (optopt)) {
+					fprintf (stderr, "%s: Unknown option `-%c'.\n",
+						getprogname(), optopt);
+				} else {
+					fprintf (stderr,"%s: Unknown option character `\\x%x'.\n",
+						getprogname(), optopt);
+				}
+				/* fall through */
+			default:
+				usage();  /* does not return */
+				break;
+		}
+
+		next_option = getopt_long (argc, argv, short_options,
+					   long_options, &option_index);
+	}
+
+	if (gen_file != NULL) {
+		exit(generate_wav(gen_file, gen_level, 1000.0, 10) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	if (do_rx == do_tx) {
+		printf("Pick one of --rx or --tx\n");
+		usage();  /* does not return */
+	}
+	chan = do_rx ? CHAN_AFOUT : CHAN_DISCOUT;
+
+	pa = malloc(sizeof(analyzer_t));
+	if (pa == NULL) {
+		exit(EXIT_FAILURE);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (wav_file != NULL) {
+		if (analyze_wav(wav_file, chan, pa) < 0) {
+			exit(EXIT_FAILURE);
+		}
+	} else {
+#ifdef HAVE_ALSA
+		if (analyze_capture(capture_device, chan, capture_sec, pa) < 0) {
+			exit(EXIT_FAILURE);
+		}
+#else
+		(void)capture_device;
+		(void)capture_sec;
+		printf("Built without ALSA, use --file\n");
+		exit(EXIT_FAILURE);
+#endif
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	if (pa->nsamples == 0) {
+		printf("No audio\n");
+		exit(EXIT_FAILURE);
+	}
+	rms_db = db(sqrt(pa->sumsq / pa->nsamples));
+	peak_db = db(pa->peak);
+	tone_amp = analyzer_tone(pa, &tone_hz, &tone_snr);
+
+	printf("Analyzed %.1f sec of %s audio in %.3f sec (%.0fx real time)\n",
+	       (double)pa->nsamples / pa->rate, do_rx ? "AFOUT" : "DISCOUT",
+	       elapsed, pa->nsamples / (double)pa->rate / elapsed);
+	printf("  level: rms %.1f dBFS, peak %.1f dBFS\n", rms_db, peak_db);
+	printf("  tone: %.1f Hz at %.1f dBFS peak, %.1f dB over noise\n",
+	       tone_hz, db(tone_amp), tone_snr);
+
+	/* levels from noise or a clipped capture would be wrong, keep the old profile */
+	if (tone_snr < TONE_MIN_SNR_DB) {
+		printf("No test tone %.0f dB over the noise, profile not written\n", TONE_MIN_SNR_DB);
+		exit(EXIT_FAILURE);
+	}
+	if (pa->peak >= CLIP_LEVEL) {
+		printf("Capture clipped at 0 dBFS, lower %s & run again, profile not written\n",
+		       do_rx ? "the received level or -A ADC Level" : "the test tone deviation");
+		exit(EXIT_FAILURE);
+	}
+
+	if (do_rx) {
+		double new_adc = quantize(adc_db - headroom_db - peak_db,
+					  ADC_STEP_DB, ADC_MIN_DB, ADC_MAX_DB);
+
+		err_db = (new_adc - adc_db) + peak_db + headroom_db;
+		printf("ADC Level: %.1f dB -> %.1f dB, peak will be %.1f dBFS\n",
+		       adc_db, new_adc, -headroom_db + err_db);
+		if (!isnan(expect)) {
+			printf("  measured peak error vs expected: %.2f dB\n", peak_db - expect);
+		}
+		snprintf(note, sizeof(note), "ows_calib rx: peak %.1f dBFS at ADC %.1f dB, headroom %.1f dB",
+			 peak_db, adc_db, headroom_db);
+		adc_db = new_adc;
+	} else {
+		double measured_hz = tone_amp * disc_hz_fs;
+		double old_pcm = pcm_db, old_lo = lo_db;
+
+		err_db = search_tx(db(deviation_hz / measured_hz), &pcm_db, &lo_db);
+		printf("Deviation: %.0f Hz, target %.0f Hz\n", measured_hz, deviation_hz);
+		printf("PCM: %.1f dB -> %.1f dB, LO Driver Gain: %.1f dB -> %.1f dB, error %.2f dB\n",
+		       old_pcm, pcm_db, old_lo, lo_db, err_db);
+		if (!isnan(expect)) {
+			printf("  measured deviation error vs expected: %.1f Hz (%.2f%%)\n",
+			       measured_hz - expect, 100.0 * (measured_hz - expect) / expect);
+		}
+		snprintf(note, sizeof(note), "ows_calib tx: %.0f Hz deviation at PCM %.1f dB, LO %.1f dB, target %.0f Hz",
+			 measured_hz, old_pcm, old_lo, deviation_hz);
+	}
+
+	if (write_profile(base_profile, out_profile, note, adc_db, pcm_db, lo_db,
+			  do_rx, do_tx) < 0) {
+		exit(EXIT_FAILURE);
+	}
+	free(pa);
+
+	return(0);
+}
+
+const char *getprogname(void)
+{
+	return __progname;
+}
+
+/*
+ * Print usage information and exit
+ *  - does not return
+ */
+static void usage(void)
+{
+	printf("Usage:  %s [options] --rx|--tx\n", getprogname());
+	printf("  Version: %s\n", PROG_VERSION);
+	printf("  -r  --rx         Set ADC Level from AFOUT (left) audio\n");
+	printf("  -t  --tx         Set PCM & LO Driver Gain from DISCOUT (right) test tone\n");
+	printf("  -f  --file       Analyze 16 bit WAV file instead of capturing\n");
+	printf("  -a  --capture    Capture device (plughw:CARD=udrc)\n");
+	printf("  -s  --seconds    Capture time in sec (%d)\n", DEFAULT_CAPTURE_SEC);
+	printf("  -m  --mixer      Mixer profile to start from (%s)\n", OWS_MIXER_PROFILE);
+	printf("  -o  --output     Write new mixer profile here (- for stdout)\n");
+	printf("  -H  --headroom   rx peak headroom in dB (%.1f)\n", DEFAULT_HEADROOM_DB);
+	printf("  -D  --deviation  tx target deviation in Hz (%.0f)\n", DEFAULT_DEVIATION_HZ);
+	printf("  -k  --disc       Discriminator Hz deviation at full scale (%.0f)\n", DEFAULT_DISC_HZ_FS);
+	printf("  -A  --adc        ADC Level in dB during capture (-1.0)\n");
+	printf("  -P  --pcm        PCM in dB during test tone (0.0)\n");
+	printf("  -L  --lo         LO Driver Gain in dB during test tone (5.0)\n");
+	printf("  -e  --expect     Known peak dBFS (rx) or deviation Hz (tx), reports error\n");
+	printf("  -G  --generate   Write a 10 sec 1 kHz test WAV file & exit\n");
+	printf("  -l  --level      Test tone level in dBFS (-12.0)\n");
+	printf("  -V  --verbose    Print verbose messages\n");
+	printf("  -d  --debug      Turn on debug messages\n");
+	printf("  -h  --help       Display this usage info\n");
+
+	exit(EXIT_SUCCESS);
+}
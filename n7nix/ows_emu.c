@@ -0,0 +1,538 @@
+/*
+ * Emulate a Dorji DRA818V module on a pseudo terminal
+ *  - answers the commands used by ows_init & ows_scan
+ *  - can hang after a number of commands until it is power cycled
+ *  - can carry Poisson packet traffic, counts packets a scan saw
+ *  - S+ replies are noise for a while after a retune, longer for a
+ *    bigger frequency step
+ *  - noisy channels & weak packets follow the AT+DMOSETGROUP squelch
+ *  - power is controlled by Activate line writes from ows_gpio
+ *    when OWS_GPIO_SIM points at the gpio fifo
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/stat.h>
+
+#include "ows_gpio.h"
+
+#define PROG_VERSION "1.0"
+#define DEFAULT_LINK "/tmp/ows_emu_tty"
+#define DEFAULT_GPIO_FIFO "/tmp/ows_gpio_sim"
+#define SIZE_LINEBUF 128
+#define DEFAULT_REPLY_MS 20
+#define DEFAULT_BOOT_MS 300
+#define DEFAULT_PACKET_MS 600
+#define DEFAULT_SQUELCH 4	/* ows_init default */
+#define MAX_NOISY 8
+
+static void usage(void);
+const char *getprogname(void);
+static void handle_command(int masterfd, char *cmd);
+static void handle_gpio(char *line);
+static double now_ms(void);
+
+int DebugFlag = false;
+int gverbose_flag = false;
+
+extern char *__progname;
+
+/* emulated module */
+static struct {
+	bool powered;
+	bool hung;
+	bool configured;
+	double boot_until_ms;
+	unsigned long cmdcount;
+	unsigned long hang_at;		/* command count to hang at, 0 never */
+	int sq;				/* squelch level from AT+DMOSETGROUP */
+	/* stats */
+	unsigned long power_cycles;
+	unsigned long ignored;
+	unsigned long unconfigured;
+} dra = { .powered = true, .configured = true, .sq = DEFAULT_SQUELCH };
+
+static int reply_ms = DEFAULT_REPLY_MS;
+static int boot_ms = DEFAULT_BOOT_MS;
+static int busy_pct = 0;
+static unsigned long hang_repeat = 0;
+
+/* packet traffic */
+static struct {
+	double rate;		/* per minute, 0 off */
+	int len_ms;
+	double start_ms;
+	double end_ms;
+	bool seen;
+	int level;		/* 1-8 weak, heard above this squelch, 9 strong */
+	int weak_pct;
+	unsigned long count;
+	unsigned long seen_count;
+} pkt = { .len_ms = DEFAULT_PACKET_MS };
+
+/* synthesizer settling after S+ to a new frequency */
+static struct {
+	double base_ms;
+	double per_mhz_ms;
+	double mhz;
+	double until_ms;
+	unsigned long retunes;
+} settle;
+
+/* channels where squelch opens on noise, pct of S+ at squelch 0 */
+static struct {
+	double mhz;
+	double pct;
+	unsigned long trips;
+} noisy[MAX_NOISY];
+static int nnoisy;
+
+static volatile sig_atomic_t done;
+
+static void sighandler(int sig)
+{
+	done = 1;
+}
+
+int main(int argc, char *argv[])
+{
+	/* For command line parsing */
+	int next_option;
+	int option_index = 0; /* getopt_long stores the option index here. */
+
+	char *link_path = DEFAULT_LINK;
+	char *gpio_path = DEFAULT_GPIO_FIFO;
+	int masterfd, slavefd, gpiofd, gpiowfd;
+	char linebuf[SIZE_LINEBUF], gpiobuf[SIZE_LINEBUF];
+	int linecnt = 0, gpiocnt = 0;
+	struct termios options;
+	struct pollfd pfd[2];
+	char *slave_name;
+	int iocnt, i;
+
+	/* short options */
+	static const char *short_options = "hVdl:g:r:B:b:H:R:p:P:t:m:n:w:";
+	/* long options */
+	static struct option long_options[] =
+	{
+		/* These options set a flag. */
+		{"verbose",     no_argument,  &gverbose_flag, true},
+		{"debug",       no_argument,  &DebugFlag, true},
+		/* These options don't set a flag.
+		We distinguish them by their indices. */
+		{"help",        no_argument,       NULL, 'h'},
+		{"link",        required_argument, NULL, 'l'},
+		{"gpio",        required_argument, NULL, 'g'},
+		{"reply",       required_argument, NULL, 'r'},
+		{"boot",        required_argument, NULL, 'B'},
+		{"busy",        required_argument, NULL, 'b'},
+		{"hang",        required_argument, NULL, 'H'},
+		{"repeat",      required_argument, NULL, 'R'},
+		{"packets",     required_argument, NULL, 'p'},
+		{"packet-ms",   required_argument, NULL, 'P'},
+		{"settle",      required_argument, NULL, 't'},
+		{"settle-mhz",  required_argument, NULL, 'm'},
+		{"noise",       required_argument, NULL, 'n'},
+		{"weak",        required_argument, NULL, 'w'},
+		{NULL, no_argument, NULL, 0} /* array termination */
+	};
+
+	opterr = 0;
+	option_index = 0;
+	next_option = getopt_long (argc, argv, short_options,
+				   long_options, &option_index);
+
+	while( next_option != -1 ) {
+
+		switch (next_option) {
+			case 0:   /* long option without a short arg */
+				break;
+			case 'l':
+				link_path = optarg;
+				break;
+			case 'g':
+				gpio_path = optarg;
+				break;
+			case 'r':   /* reply delay in msec */
+				reply_ms = atoi(optarg);
+				break;
+			case 'B':   /* boot time after power up in msec */
+				boot_ms = atoi(optarg);
+				break;
+			case 'b':   /* percent of scans that find a signal */
+				busy_pct = atoi(optarg);
+				break;
+			case 'H':   /* hang after this many commands */
+				dra.hang_at = strtoul(optarg, NULL, 0);
+				break;
+			case 'R':   /* hang again this many commands after power up */
+				hang_repeat = strtoul(optarg, NULL, 0);
+				break;
+			case 'p':   /* packets per minute */
+				pkt.rate = atof(optarg);
+				break;
+			case 'P':   /* packet length in msec */
+				pkt.len_ms = atoi(optarg);
+				break;
+			case 't':   /* settle time of any retune in msec */
+				settle.base_ms = atof(optarg);
+				break;
+			case 'm':   /* extra settle time per MHz of retune in msec */
+				settle.per_mhz_ms = atof(optarg);
+				break;
+			case 'n':   /* noisy channel, MHz=pct */
+				if (nnoisy == MAX_NOISY ||
+				    sscanf(optarg, "%lf=%lf", &noisy[nnoisy].mhz, &noisy[nnoisy].pct) != 2) {
+					usage();  /* does not return */
+				}
+				nnoisy++;
+				break;
+			case 'w':   /* percent of packets that are weak */
+				pkt.weak_pct = atoi(optarg);
+				break;
+			case 'V':   /* set verbose flag */
+				gverbose_flag = true;
+				break;
+			case 'd':
+				DebugFlag = true;
+				break;
+			case 'h':
+				usage();  /* does not return */
+				break;
+			case '?':
+				if (isprint (optopt)) {
+					fprintf (stderr, "%s: Unknown option `-%c'.\n",
+						getprogname(), optopt);
+				} else {
+					fprintf (stderr,"%s: Unknown option character `\\x%x'.\n",
+						getprogname(), optopt);
+				}
+				/* fall through */
+			default:
+				usage();  /* does not return */
+				break;
+		}
+
+		next_option = getopt_long (argc, argv, short_options,
+					   long_options, &option_index);
+	}
+
+	masterfd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (masterfd < 0 || grantpt(masterfd) < 0 || unlockpt(masterfd) < 0) {
+		perror("posix_openpt");
+		exit(EXIT_FAILURE);
+	}
+	slave_name = ptsname(masterfd);
+
+	/* Keep slave open so the master never sees a hangup, no echo */
+	slavefd = open(slave_name, O_RDWR | O_NOCTTY);
+	if (slavefd < 0 || tcgetattr(slavefd, &options) < 0) {
+		perror(slave_name);
+		exit(EXIT_FAILURE);
+	}
+	cfmakeraw(&options);
+	tcsetattr(slavefd, TCSANOW, &options);
+
+	unlink(link_path);
+	if (symlink(slave_name, link_path) < 0) {
+		perror(link_path);
+		exit(EXIT_FAILURE);
+	}
+
+	if (mkfifo(gpio_path, 0666) < 0 && errno != EEXIST) {
+		perror(gpio_path);
+		exit(EXIT_FAILURE);
+	}
+	gpiofd = open(gpio_path, O_RDONLY | O_NONBLOCK);
+	/* dummy writer, fifo never reads end of file */
+	gpiowfd = open(gpio_path, O_WRONLY | O_NONBLOCK);
+	if (gpiofd < 0 || gpiowfd < 0) {
+		perror(gpio_path);
+		exit(EXIT_FAILURE);
+	}
+
+	signal(SIGINT, sighandler);
+	signal(SIGTERM, sighandler);
+
+	printf("DRA818V emulator on %s -> %s, gpio fifo %s\n",
+	       link_path, slave_name, gpio_path);
+	printf("  reply %d ms, boot %d ms, busy %d%%, hang at %lu, repeat %lu\n",
+	       reply_ms, boot_ms, busy_pct, dra.hang_at, hang_repeat);
+	if (settle.base_ms > 0.0 || settle.per_mhz_ms > 0.0) {
+		printf("  retune settle %.0f ms + %.1f ms per MHz\n",
+		       settle.base_ms, settle.per_mhz_ms);
+	}
+	srand48(time(NULL));
+	if (pkt.rate > 0.0) {
+		printf("  packets %.1f per minute, %d ms long, %d%% weak\n",
+		       pkt.rate, pkt.len_ms, pkt.weak_pct);
+		pkt.end_ms = now_ms();
+	}
+	for (i = 0; i < nnoisy; i++) {
+		printf("  noise on %.4f MHz, %.0f%% of scans at squelch 0, halved each level\n",
+		       noisy[i].mhz, noisy[i].pct);
+	}
+	fflush(stdout);
+
+	pfd[0].fd = masterfd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = gpiofd;
+	pfd[1].events = POLLIN;
+
+	while (!done) {
+		if (poll(pfd, 2, 1000) <= 0) {
+			continue;
+		}
+		if (pfd[1].revents & POLLIN) {
+			iocnt = read(gpiofd, &gpiobuf[gpiocnt], 1);
+			if (iocnt == 1) {
+				if (gpiobuf[gpiocnt] == '\n' || gpiocnt == SIZE_LINEBUF - 2) {
+					gpiobuf[gpiocnt] = '\0';
+					handle_gpio(gpiobuf);
+					gpiocnt = 0;
+				} else {
+					gpiocnt++;
+				}
+			}
+		}
+		if (pfd[0].revents & POLLIN) {
+			iocnt = read(masterfd, &linebuf[linecnt], 1);
+			if (iocnt != 1) {
+				continue;
+			}
+			if (linebuf[linecnt] == '\n' || linecnt == SIZE_LINEBUF - 2) {
+				linebuf[linecnt] = '\0';
+				if (linecnt > 0 && linebuf[linecnt-1] == '\r') {
+					linebuf[linecnt-1] = '\0';
+				}
+				handle_command(masterfd, linebuf);
+				linecnt = 0;
+			} else {
+				linecnt++;
+			}
+		}
+	}
+
+	printf("\nCommands: %lu, ignored: %lu, unconfigured scans: %lu, power cycles: %lu\n",
+	       dra.cmdcount, dra.ignored, dra.unconfigured, dra.power_cycles);
+	if (pkt.rate > 0.0) {
+		/* next packet has not started yet */
+		if (now_ms() < pkt.start_ms) {
+			pkt.count--;
+		}
+		printf("Packets: %lu sent, %lu seen by a scan\n", pkt.count, pkt.seen_count);
+	}
+	if (settle.retunes > 0) {
+		printf("Retunes: %lu\n", settle.retunes);
+	}
+	for (i = 0; i < nnoisy; i++) {
+		printf("Noise: %.4f MHz %lu false signals\n", noisy[i].mhz, noisy[i].trips);
+	}
+	unlink(link_path);
+	close(gpiofd);
+	close(gpiowfd);
+	close(slavefd);
+	close(masterfd);
+
+	return(0);
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0);
+}
+
+static void reply(int masterfd, const char *resp)
+{
+	char outbuf[SIZE_LINEBUF];
+	struct timespec ts = { reply_ms / 1000, (reply_ms % 1000) * 1000000L };
+	int len;
+
+	nanosleep(&ts, NULL);
+	len = snprintf(outbuf, sizeof(outbuf), "%s\r\n", resp);
+	if (write(masterfd, outbuf, len) != len) {
+		perror("write");
+	}
+}
+
+/* Step Poisson packet traffic to now, returns true while a packet is on air */
+static bool packet_busy(double now)
+{
+	if (pkt.rate <= 0.0) {
+		return(false);
+	}
+	while (now >= pkt.end_ms) {
+		pkt.start_ms = pkt.end_ms - log(1.0 - drand48()) * 60000.0 / pkt.rate;
+		pkt.end_ms = pkt.start_ms + pkt.len_ms;
+		pkt.seen = false;
+		pkt.level = rand() % 100 < pkt.weak_pct ? 1 + rand() % 8 : 9;
+		pkt.count++;
+	}
+	return(now >= pkt.start_ms && pkt.level > dra.sq);
+}
+
+/* Squelch opened by noise, each squelch level halves the rate */
+static bool noise_busy(double mhz)
+{
+	int i;
+
+	for (i = 0; i < nnoisy; i++) {
+		if (fabs(mhz - noisy[i].mhz) < 0.00005) {
+			if (drand48() * 100.0 < noisy[i].pct / (1 << dra.sq)) {
+				noisy[i].trips++;
+				return(true);
+			}
+			break;
+		}
+	}
+	return(false);
+}
+
+/* S+<freq>, S=0 signal, S=1 no signal */
+static void handle_scan(int masterfd, char *cmd)
+{
+	double mhz = atof(&cmd[2]);
+	bool busy;
+
+	if (!dra.configured) {
+		dra.unconfigured++;
+	}
+	if (mhz != settle.mhz) {
+		if (settle.mhz != 0.0) {
+			settle.until_ms = now_ms() + settle.base_ms +
+					  settle.per_mhz_ms * fabs(mhz - settle.mhz);
+			settle.retunes++;
+		}
+		settle.mhz = mhz;
+	}
+	if (now_ms() < settle.until_ms) {
+		/* synthesizer not locked, squelch chatters */
+		reply(masterfd, rand() & 1 ? "S=0" : "S=1");
+		return;
+	}
+
+	busy = packet_busy(now_ms());
+	if (busy && !pkt.seen) {
+		pkt.seen = true;
+		pkt.seen_count++;
+	}
+	reply(masterfd, busy || noise_busy(mhz) || rand() % 100 < busy_pct ? "S=0" : "S=1");
+}
+
+static void handle_command(int masterfd, char *cmd)
+{
+	if (cmd[0] == '\0') {
+		return;
+	}
+	dra.cmdcount++;
+
+	if (dra.hang_at != 0 && dra.cmdcount == dra.hang_at && !dra.hung) {
+		dra.hung = true;
+		printf("Hanging at command %lu: %s\n", dra.cmdcount, cmd);
+		fflush(stdout);
+	}
+	if (!dra.powered || dra.hung || now_ms() < dra.boot_until_ms) {
+		dra.ignored++;
+		if (gverbose_flag) {
+			printf("ignored: %s\n", cmd);
+		}
+		return;
+	}
+	if(DebugFlag) {
+		printf("command: %s\n", cmd);
+	}
+
+	if (strcmp(cmd, "AT+DMOCONNECT") == 0) {
+		reply(masterfd, "+DMOCONNECT:0");
+	} else if (strncmp(cmd, "AT+DMOSETGROUP=", 15) == 0) {
+		/* GBW,TFV,RFV,Tx_CTCSS,SQ,Rx_CTCSS */
+		if (sscanf(cmd + 15, "%*[^,],%*[^,],%*[^,],%*[^,],%d", &dra.sq) != 1) {
+			printf("bad squelch: %s\n", cmd);
+		}
+		dra.configured = true;
+		reply(masterfd, "+DMOSETGROUP:0");
+	} else if (strncmp(cmd, "AT+SETFILTER=", 13) == 0) {
+		reply(masterfd, "+DMOSETFILTER:0");
+	} else if (strncmp(cmd, "AT+DMOSETVOLUME=", 16) == 0) {
+		reply(masterfd, "+DMOSETVOLUME:0");
+	} else if (strncmp(cmd, "S+", 2) == 0) {
+		handle_scan(masterfd, cmd);
+	} else {
+		printf("unknown command: %s\n", cmd);
+	}
+}
+
+/* Line changes from ows_gpio, "line=value" */
+static void handle_gpio(char *line)
+{
+	int gpio, value;
+
+	if (sscanf(line, "%d=%d", &gpio, &value) != 2 || gpio != OWS_GPIO_ACTIVATE) {
+		return;
+	}
+	if (value == 0 && dra.powered) {
+		dra.powered = false;
+		dra.hung = false;
+		/* assume settings are lost while powered down */
+		dra.configured = false;
+		printf("Power down at command %lu\n", dra.cmdcount);
+	} else if (value == 1 && !dra.powered) {
+		dra.powered = true;
+		dra.power_cycles++;
+		dra.boot_until_ms = now_ms() + boot_ms;
+		if (hang_repeat != 0) {
+			dra.hang_at = dra.cmdcount + hang_repeat;
+		}
+		printf("Power up, ready in %d ms\n", boot_ms);
+	}
+	fflush(stdout);
+}
+
+const char *getprogname(void)
+{
+	return __progname;
+}
+
+/*
+ * Print usage information and exit
+ *  - does not return
+ */
+static void usage(void)
+{
+	printf("Usage:  %s [options]\n", getprogname());
+	printf("  Version: %s\n", PROG_VERSION);
+	printf("  -l  --link       Serial device link name (%s)\n", DEFAULT_LINK);
+	printf("  -g  --gpio       Gpio fifo, set %s to this (%s)\n",
+	       OWS_GPIO_SIM_ENV, DEFAULT_GPIO_FIFO);
+	printf("  -r  --reply      Reply delay in msec (%d)\n", DEFAULT_REPLY_MS);
+	printf("  -B  --boot       Time from power up to ready in msec (%d)\n", DEFAULT_BOOT_MS);
+	printf("  -b  --busy       Percent of scans that find a signal\n");
+	printf("  -H  --hang       Hang after this many commands\n");
+	printf("  -R  --repeat     Hang again this many commands after power up\n");
+	printf("  -p  --packets    Poisson packets per minute\n");
+	printf("  -P  --packet-ms  Packet length in msec (%d)\n", DEFAULT_PACKET_MS);
+	printf("  -t  --settle     Noisy S+ replies for this many msec after a retune\n");
+	printf("  -m  --settle-mhz Extra settle msec per MHz of retune\n");
+	printf("  -n  --noise      Noisy channel MHz=pct, pct of scans with squelch 0 open on noise\n");
+	printf("  -w  --weak       Percent of packets weak enough for squelch 1-8 to miss\n");
+	printf("  -V  --verbose    Print verbose messages\n");
+	printf("  -d  --debug      Turn on debug messages\n");
+	printf("  -h  --help       Display this usage info\n");
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,480 @@
+/*
+ * Scan event publish/subscribe for ows_scan consumers
+ *
+ * Two transports:
+ *  - Unix datagram: each subscriber binds a socket in OWS_EVENT_DIR,
+ *    the publisher sends every event to every socket found there
+ *  - Shared memory: single writer ring of OWS_EVENT_RING events,
+ *    each subscriber keeps its own read index & sleeps on a futex
+ *
+ * The publisher never blocks, a subscriber that falls behind loses
+ * events. Lost events show up as gaps in the event sequence number
+ * and are counted by both sides.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "ows_event.h"
+
+#define EVRING_MAGIC 0x4f575345	/* OWSE */
+#define EVRING_MASK (OWS_EVENT_RING - 1)
+#define EVDEST_CHECK_NS 1000000000LL	/* subscriber directory checked once a sec */
+
+extern int DebugFlag;
+
+typedef struct evslot {
+	uint64_t idx;		/* ring index held in slot, ~0 while written */
+	ows_event_t ev;
+} evslot_t;
+
+typedef struct evring {
+	uint32_t magic;
+	uint32_t size;
+	uint32_t futex;		/* bumped on every publish */
+	uint32_t waiters;	/* subscribers sleeping on futex */
+	uint64_t head;		/* next ring index to be written */
+	evslot_t slot[OWS_EVENT_RING];
+} evring_t;
+
+typedef struct evdest {
+	struct sockaddr_un addr;
+	unsigned long sent;
+	unsigned long dropped;
+} evdest_t;
+
+static struct {
+	int transports;
+	uint32_t seq;
+	/* datagram */
+	int sockfd;
+	evdest_t dest[OWS_EVENT_MAX_SUBS];
+	int ndest;
+	struct timespec dir_mtime;
+	int64_t dir_checked_ns;
+	/* shared memory */
+	evring_t *ring;
+	unsigned long published;
+} pub = { .sockfd = -1 };
+
+struct ows_evsub {
+	int transport;
+	/* datagram */
+	int sockfd;
+	struct sockaddr_un addr;
+	/* shared memory */
+	evring_t *ring;
+	uint64_t idx;
+	/* both */
+	uint32_t next_seq;
+	int have_seq;
+	unsigned long missed;
+};
+
+int64_t ows_event_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static int futex(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout)
+{
+	return(syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0));
+}
+
+/*
+ * Rebuild the datagram destination list when the subscriber
+ * directory changes, keeps drop counts of existing subscribers
+ */
+static void evdest_refresh(int64_t now_ns)
+{
+	struct stat st;
+	DIR *dir;
+	struct dirent *dent;
+	evdest_t newdest[OWS_EVENT_MAX_SUBS];
+	int i, n = 0;
+
+	/* no stat on every publish, new subscribers wait up to a check period */
+	if (pub.dir_checked_ns != 0 && now_ns - pub.dir_checked_ns < EVDEST_CHECK_NS) {
+		return;
+	}
+	pub.dir_checked_ns = now_ns;
+	if (stat(OWS_EVENT_DIR, &st) < 0) {
+		pub.ndest = 0;
+		return;
+	}
+	if (st.st_mtim.tv_sec == pub.dir_mtime.tv_sec &&
+	    st.st_mtim.tv_nsec == pub.dir_mtime.tv_nsec) {
+		return;
+	}
+	pub.dir_mtime = st.st_mtim;
+
+	dir = opendir(OWS_EVENT_DIR);
+	if (dir == NULL) {
+		return;
+	}
+	while ((dent = readdir(dir)) != NULL && n < OWS_EVENT_MAX_SUBS) {
+		if (dent->d_name[0] == '.') {
+			continue;
+		}
+		memset(&newdest[n], 0, sizeof(evdest_t));
+		newdest[n].addr.sun_family = AF_UNIX;
+		snprintf(newdest[n].addr.sun_path, sizeof(newdest[n].addr.sun_path),
+			 "%s/%.64s", OWS_EVENT_DIR, dent->d_name);
+		for (i = 0; i < pub.ndest; i++) {
+			if (strcmp(pub.dest[i].addr.sun_path, newdest[n].addr.sun_path) == 0) {
+				newdest[n] = pub.dest[i];
+				break;
+			}
+		}
+		n++;
+	}
+	closedir(dir);
+
+	memcpy(pub.dest, newdest, n * sizeof(evdest_t));
+	pub.ndest = n;
+
+	if(DebugFlag) {
+		printf("%s: %d subscribers\n", __FUNCTION__, n);
+	}
+}
+
+/* Forget the subscriber list, the next refresh reads the directory */
+static void evdest_reset(void)
+{
+	pub.ndest = 0;
+	pub.dir_checked_ns = 0;
+	memset(&pub.dir_mtime, 0, sizeof(pub.dir_mtime));
+}
+
+static void evdest_remove(int i)
+{
+	/* subscriber went away without removing its socket */
+	unlink(pub.dest[i].addr.sun_path);
+	pub.dest[i] = pub.dest[--pub.ndest];
+}
+
+static evring_t *evring_map(int create)
+{
+	evring_t *ring;
+	int fd;
+
+	fd = shm_open(OWS_EVENT_SHM, create ? O_RDWR | O_CREAT : O_RDWR, 0660);
+	if (fd < 0) {
+		perror("shm_open " OWS_EVENT_SHM);
+		return(NULL);
+	}
+	/* subscribers count themselves as waiters, open to the scanner's group past the umask */
+	if (create && fchmod(fd, 0660) < 0) {
+		perror("fchmod " OWS_EVENT_SHM);
+		close(fd);
+		return(NULL);
+	}
+	if (create && ftruncate(fd, sizeof(evring_t)) < 0) {
+		perror("ftruncate");
+		close(fd);
+		return(NULL);
+	}
+	ring = mmap(NULL, sizeof(evring_t), PROT_READ | PROT_WRITE,
+		    MAP_SHARED, fd, 0);
+	close(fd);
+	if (ring == MAP_FAILED) {
+		perror("mmap");
+		return(NULL);
+	}
+	if (!create && ring->magic != EVRING_MAGIC) {
+		printf("%s: %s is not an event ring\n", __FUNCTION__, OWS_EVENT_SHM);
+		munmap(ring, sizeof(evring_t));
+		return(NULL);
+	}
+	return(ring);
+}
+
+/*
+ * Subscriber directory, world writable & sticky like /tmp whatever
+ * the umask of the first program to create it
+ */
+static void evdir_create(void)
+{
+	if (mkdir(OWS_EVENT_DIR, 01777) == 0) {
+		chmod(OWS_EVENT_DIR, 01777);
+	}
+}
+
+/*
+ * Start publishing events on the given transports
+ */
+int ows_event_open(int transports)
+{
+	pub.transports = transports;
+
+	if (transports & OWS_EVT_DGRAM) {
+		evdir_create();
+		pub.sockfd = socket(AF_UNIX, SOCK_DGRAM, 0);
+		if (pub.sockfd < 0) {
+			perror("socket");
+			return(-1);
+		}
+		/* first publish reads the subscriber directory */
+		evdest_reset();
+	}
+
+	if (transports & OWS_EVT_SHM) {
+		pub.ring = evring_map(1);
+		if (pub.ring == NULL) {
+			return(-1);
+		}
+		/* subscribers resync when head goes backwards */
+		__atomic_store_n(&pub.ring->head, 0, __ATOMIC_SEQ_CST);
+		pub.ring->size = OWS_EVENT_RING;
+		pub.ring->magic = EVRING_MAGIC;
+	}
+	return(0);
+}
+
+/*
+ * Publish one event to all subscribers, never blocks
+ */
+void ows_event_publish(int type, int state, const char *freq, int sig)
+{
+	ows_event_t ev;
+	evslot_t *slot;
+	uint64_t head;
+	int i;
+
+	if (pub.transports == 0) {
+		return;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.seq = pub.seq++;
+	ev.type = type;
+	ev.state = state;
+	ev.sig = sig;
+	if (freq != NULL) {
+		snprintf(ev.freq, sizeof(ev.freq), "%s", freq);
+	}
+	ev.real_sec = time(NULL);
+	ev.mono_ns = ows_event_now_ns();
+	pub.published++;
+
+	if (pub.ring != NULL) {
+		head = pub.ring->head;
+		slot = &pub.ring->slot[head & EVRING_MASK];
+
+		__atomic_store_n(&slot->idx, ~(uint64_t)0, __ATOMIC_RELAXED);
+		/* marker must be visible before any of the event, ARM reorders stores */
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		slot->ev = ev;
+		__atomic_store_n(&slot->idx, head, __ATOMIC_RELEASE);
+		__atomic_store_n(&pub.ring->head, head + 1, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&pub.ring->futex, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&pub.ring->waiters, __ATOMIC_SEQ_CST)) {
+			futex(&pub.ring->futex, FUTEX_WAKE, INT_MAX, NULL);
+		}
+	}
+
+	if (pub.sockfd >= 0) {
+		evdest_refresh(ev.mono_ns);
+		for (i = 0; i < pub.ndest; i++) {
+			if (sendto(pub.sockfd, &ev, sizeof(ev), MSG_DONTWAIT,
+				   (struct sockaddr *)&pub.dest[i].addr,
+				   sizeof(pub.dest[i].addr)) == sizeof(ev)) {
+				pub.dest[i].sent++;
+			} else if (errno == EAGAIN || errno == ENOBUFS) {
+				pub.dest[i].dropped++;
+			} else if (errno == ECONNREFUSED || errno == ENOENT) {
+				evdest_remove(i--);
+			}
+		}
+	}
+}
+
+void ows_event_stats(void)
+{
+	int i;
+
+	printf("Events published: %lu\n", pub.published);
+	for (i = 0; i < pub.ndest; i++) {
+		printf("  %s: sent %lu, dropped %lu\n", pub.dest[i].addr.sun_path,
+		       pub.dest[i].sent, pub.dest[i].dropped);
+	}
+}
+
+void ows_event_close(void)
+{
+	if (pub.sockfd >= 0) {
+		close(pub.sockfd);
+		pub.sockfd = -1;
+	}
+	evdest_reset();
+	if (pub.ring != NULL) {
+		munmap(pub.ring, sizeof(evring_t));
+		pub.ring = NULL;
+	}
+	pub.transports = 0;
+}
+
+/*
+ * Subscribe to scanner events on one transport
+ */
+ows_evsub_t *ows_evsub_open(int transport)
+{
+	static int subcnt;
+	ows_evsub_t *sub;
+
+	sub = calloc(1, sizeof(ows_evsub_t));
+	if (sub == NULL) {
+		return(NULL);
+	}
+	sub->transport = transport;
+	sub->sockfd = -1;
+
+	if (transport == OWS_EVT_DGRAM) {
+		evdir_create();
+		sub->sockfd = socket(AF_UNIX, SOCK_DGRAM, 0);
+		if (sub->sockfd < 0) {
+			perror("socket");
+			free(sub);
+			return(NULL);
+		}
+		sub->addr.sun_family = AF_UNIX;
+		snprintf(sub->addr.sun_path, sizeof(sub->addr.sun_path),
+			 "%s/sub.%d.%d", OWS_EVENT_DIR, getpid(), subcnt++);
+		unlink(sub->addr.sun_path);
+		if (bind(sub->sockfd, (struct sockaddr *)&sub->addr, sizeof(sub->addr)) < 0) {
+			perror(sub->addr.sun_path);
+			close(sub->sockfd);
+			free(sub);
+			return(NULL);
+		}
+	} else {
+		sub->ring = evring_map(0);
+		if (sub->ring == NULL) {
+			free(sub);
+			return(NULL);
+		}
+		/* only new events */
+		sub->idx = __atomic_load_n(&sub->ring->head, __ATOMIC_ACQUIRE);
+	}
+	return(sub);
+}
+
+static void evsub_count(ows_evsub_t *sub, ows_event_t *ev)
+{
+	if (sub->have_seq && ev->seq != sub->next_seq) {
+		sub->missed += (uint32_t)(ev->seq - sub->next_seq);
+	}
+	sub->next_seq = ev->seq + 1;
+	sub->have_seq = 1;
+}
+
+static int evsub_ring_read(ows_evsub_t *sub, ows_event_t *ev, int timeout_ms)
+{
+	evring_t *ring = sub->ring;
+	evslot_t *slot;
+	uint64_t head;
+	uint32_t fval;
+	struct timespec ts;
+
+	while (1) {
+		fval = __atomic_load_n(&ring->futex, __ATOMIC_SEQ_CST);
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+		if (head < sub->idx) {
+			/* publisher restarted */
+			sub->idx = head;
+			sub->have_seq = 0;
+		}
+		if (head - sub->idx > OWS_EVENT_RING) {
+			/* overrun, skip to oldest event still in ring */
+			sub->idx = head - OWS_EVENT_RING;
+		}
+		if (sub->idx < head) {
+			slot = &ring->slot[sub->idx & EVRING_MASK];
+			if (__atomic_load_n(&slot->idx, __ATOMIC_ACQUIRE) == sub->idx) {
+				*ev = slot->ev;
+				__atomic_thread_fence(__ATOMIC_ACQUIRE);
+				if (__atomic_load_n(&slot->idx, __ATOMIC_RELAXED) == sub->idx) {
+					sub->idx++;
+					evsub_count(sub, ev);
+					return(1);
+				}
+			}
+			/* slot was overwritten while reading */
+			sub->idx++;
+			continue;
+		}
+		if (timeout_ms == 0) {
+			return(0);
+		}
+
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+		__atomic_add_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+		if (futex(&ring->futex, FUTEX_WAIT, fval, timeout_ms < 0 ? NULL : &ts) < 0 &&
+		    errno == ETIMEDOUT) {
+			__atomic_sub_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+			return(0);
+		}
+		__atomic_sub_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+/*
+ * Wait up to timeout_ms for the next event, -1 waits forever
+ *  returns 1 with event, 0 on timeout, -1 on error
+ */
+int ows_evsub_read(ows_evsub_t *sub, ows_event_t *ev, int timeout_ms)
+{
+	struct pollfd pfd;
+	int rv;
+
+	if (sub->ring != NULL) {
+		return(evsub_ring_read(sub, ev, timeout_ms));
+	}
+
+	pfd.fd = sub->sockfd;
+	pfd.events = POLLIN;
+	rv = poll(&pfd, 1, timeout_ms);
+	if (rv <= 0) {
+		return(rv < 0 && errno != EINTR ? -1 : 0);
+	}
+	if (recv(sub->sockfd, ev, sizeof(*ev), 0) != sizeof(*ev)) {
+		return(-1);
+	}
+	evsub_count(sub, ev);
+	return(1);
+}
+
+unsigned long ows_evsub_missed(ows_evsub_t *sub)
+{
+	return(sub->missed);
+}
+
+void ows_evsub_close(ows_evsub_t *sub)
+{
+	if (sub->sockfd >= 0) {
+		close(sub->sockfd);
+		unlink(sub->addr.sun_path);
+	}
+	if (sub->ring != NULL) {
+		munmap(sub->ring, sizeof(evring_t));
+	}
+	free(sub);
+}
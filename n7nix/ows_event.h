@@ -0,0 +1,56 @@
+/*
+ * Scan event publish/subscribe for ows_scan consumers
+ */
+#ifndef OWS_EVENT_H
+#define OWS_EVENT_H
+
+#include <stdint.h>
+
+/* Subscriber datagram sockets are created in this directory */
+#define OWS_EVENT_DIR "/tmp/ows_events"
+/* Shared memory event ring name, see shm_open(3) */
+#define OWS_EVENT_SHM "/ows_events"
+#define OWS_EVENT_RING 256	/* must be a power of 2 */
+#define OWS_EVENT_MAX_SUBS 32
+
+/* transports, may be or'ed together for the publisher */
+#define OWS_EVT_DGRAM 0x01
+#define OWS_EVT_SHM   0x02
+
+/* event types */
+#define OWS_EV_HIT   1	/* channel went busy */
+#define OWS_EV_CLEAR 2	/* channel went idle or was left while busy */
+#define OWS_EV_STATE 3	/* scanner state change */
+
+/* scanner states for OWS_EV_STATE */
+#define OWS_STATE_START  1
+#define OWS_STATE_RETUNE 2
+#define OWS_STATE_STOP   3
+
+typedef struct ows_event {
+	uint32_t seq;		/* publisher sequence number, gaps are drops */
+	uint16_t type;
+	uint16_t state;
+	int32_t sig;		/* S+ response code, 1 is no signal */
+	char freq[12];		/* frequency as sent to module, 144.3900 */
+	int64_t mono_ns;	/* CLOCK_MONOTONIC time of event */
+	int64_t real_sec;	/* wall clock time of event */
+} ows_event_t;
+
+typedef struct ows_evsub ows_evsub_t;
+
+/* Publisher, used by ows_scan */
+int ows_event_open(int transports);
+void ows_event_publish(int type, int state, const char *freq, int sig);
+void ows_event_stats(void);
+void ows_event_close(void);
+
+/* Subscriber */
+ows_evsub_t *ows_evsub_open(int transport);
+int ows_evsub_read(ows_evsub_t *sub, ows_event_t *ev, int timeout_ms);
+unsigned long ows_evsub_missed(ows_evsub_t *sub);
+void ows_evsub_close(ows_evsub_t *sub);
+
+int64_t ows_event_now_ns(void);
+
+#endif /* OWS_EVENT_H */
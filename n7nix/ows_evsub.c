@@ -0,0 +1,355 @@
+/*
+ * Subscribe to ows_scan events & print them
+ *  - also benchmarks event delivery latency & fan-out cost
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "ows_event.h"
+
+#define PROG_VERSION "1.0"
+#define BENCH_DEFAULT_EVENTS 2000
+#define BENCH_DEFAULT_INTERVAL 200 /* usec between published events */
+
+/* Per subscriber benchmark result, sent back to parent over a pipe */
+typedef struct bench_result {
+	unsigned long received;
+	unsigned long missed;
+	double lat_avg_us;
+	double lat_p99_us;
+	double lat_max_us;
+} bench_result_t;
+
+static void usage(void);
+const char *getprogname(void);
+static void print_event(ows_event_t *ev, unsigned long missed);
+static int run_bench(int transport, int max_subs, int nevents, int interval_us);
+
+int DebugFlag = false;
+int gverbose_flag = false;
+
+extern char *__progname;
+
+static volatile sig_atomic_t done;
+
+static void sighandler(int sig)
+{
+	done = 1;
+}
+
+int main(int argc, char *argv[])
+{
+	/* For command line parsing */
+	int next_option;
+	int option_index = 0; /* getopt_long stores the option index here. */
+
+	int transport = OWS_EVT_DGRAM;
+	int bench_subs = 0;
+	int bench_events = BENCH_DEFAULT_EVENTS;
+	int bench_interval = BENCH_DEFAULT_INTERVAL;
+	ows_evsub_t *sub;
+	ows_event_t ev;
+	int rv;
+
+	/* short options */
+	static const char *short_options = "hVdmb:n:i:";
+	/* long options */
+	static struct option long_options[] =
+	{
+		/* These options set a flag. */
+		{"verbose",     no_argument,  &gverbose_flag, true},
+		{"debug",       no_argument,  &DebugFlag, true},
+		/* These options don't set a flag.
+		We distinguish them by their indices. */
+		{"help",        no_argument,       NULL, 'h'},
+		{"shm",         no_argument,       NULL, 'm'},
+		{"bench",       required_argument, NULL, 'b'},
+		{"events",      required_argument, NULL, 'n'},
+		{"interval",    required_argument, NULL, 'i'},
+		{NULL, no_argument, NULL, 0} /* array termination */
+	};
+
+	opterr = 0;
+	option_index = 0;
+	next_option = getopt_long (argc, argv, short_options,
+				   long_options, &option_index);
+
+	while( next_option != -1 ) {
+
+		switch (next_option) {
+			case 0:   /* long option without a short arg */
+				break;
+			case 'm':   /* use shared memory ring */
+				transport = OWS_EVT_SHM;
+				break;
+			case 'b':   /* benchmark up to this many subscribers */
+				bench_subs = atoi(optarg);
+				if (bench_subs < 1 || bench_subs > OWS_EVENT_MAX_SUBS) {
+					printf("Subscriber count must be 1 to %d\n",
+					       OWS_EVENT_MAX_SUBS);
+					usage();
+				}
+				break;
+			case 'n':
+				bench_events = atoi(optarg);
+				break;
+			case 'i':
+				bench_interval = atoi(optarg);
+				break;
+			case 'V':   /* set verbose flag */
+				gverbose_flag = true;
+				break;
+			case 'd':
+				DebugFlag = true;
+				break;
+			case 'h':
+				usage();  /* does not return */
+				break;
+			case '?':
+				if (isprint (optopt)) {
+					fprintf (stderr, "%s: Unknown option `-%c'.\n",
+						getprogname(), optopt);
+				} else {
+					fprintf (stderr,"%s: Unknown option character `\\x%x'.\n",
+						getprogname(), optopt);
+				}
+				/* fall through */
+			default:
+				usage();  /* does not return */
+				break;
+		}
+
+		next_option = getopt_long (argc, argv, short_options,
+					   long_options, &option_index);
+	}
+
+	if (bench_subs > 0) {
+		exit(run_bench(transport, bench_subs, bench_events, bench_interval));
+	}
+
+	sub = ows_evsub_open(transport);
+	if (sub == NULL) {
+		exit(EXIT_FAILURE);
+	}
+	signal(SIGINT, sighandler);
+	signal(SIGTERM, sighandler);
+
+	while (!done) {
+		rv = ows_evsub_read(sub, &ev, 1000);
+		if (rv < 0) {
+			break;
+		}
+		if (rv > 0) {
+			print_event(&ev, ows_evsub_missed(sub));
+		}
+	}
+	printf("Missed events: %lu\n", ows_evsub_missed(sub));
+	ows_evsub_close(sub);
+
+	return(0);
+}
+
+static void print_event(ows_event_t *ev, unsigned long missed)
+{
+	time_t evtime = ev->real_sec;
+	char *pTimeBuf = ctime(&evtime);
+
+	/* get rid of crlf line terminator */
+	pTimeBuf[strlen(pTimeBuf)-1] = '\0';
+
+	switch (ev->type) {
+		case OWS_EV_HIT:
+			printf("%s HIT   freq: %s, sig: %d", pTimeBuf, ev->freq, ev->sig);
+			break;
+		case OWS_EV_CLEAR:
+			printf("%s CLEAR freq: %s", pTimeBuf, ev->freq);
+			break;
+		case OWS_EV_STATE:
+			printf("%s STATE %s freq: %s", pTimeBuf,
+			       ev->state == OWS_STATE_START ? "start" :
+			       ev->state == OWS_STATE_RETUNE ? "retune" :
+			       ev->state == OWS_STATE_STOP ? "stop" : "unknown",
+			       ev->freq);
+			break;
+		default:
+			printf("%s type %d", pTimeBuf, ev->type);
+			break;
+	}
+	if (gverbose_flag) {
+		printf(" seq: %u, missed: %lu", ev->seq, missed);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double da = *(const double *)a, db = *(const double *)b;
+
+	return((da > db) - (da < db));
+}
+
+/*
+ * Benchmark subscriber, runs until the stop event or 1 sec idle
+ */
+static void bench_subscriber(int transport, int nevents, int readyfd, int resultfd)
+{
+	ows_evsub_t *sub;
+	ows_event_t ev;
+	bench_result_t result;
+	double *lat_us, sum = 0.0;
+	unsigned long n = 0;
+
+	memset(&result, 0, sizeof(result));
+	lat_us = calloc(nevents, sizeof(double));
+	sub = ows_evsub_open(transport);
+	if (sub == NULL || lat_us == NULL) {
+		_exit(1);
+	}
+	if (write(readyfd, "r", 1) != 1) {
+		_exit(1);
+	}
+
+	while (ows_evsub_read(sub, &ev, 1000) > 0) {
+		if (ev.type == OWS_EV_STATE && ev.state == OWS_STATE_STOP) {
+			break;
+		}
+		if (ev.type == OWS_EV_HIT && n < (unsigned long)nevents) {
+			lat_us[n] = (ows_event_now_ns() - ev.mono_ns) / 1000.0;
+			sum += lat_us[n];
+			n++;
+		}
+	}
+
+	result.received = n;
+	result.missed = ows_evsub_missed(sub);
+	if (n > 0) {
+		qsort(lat_us, n, sizeof(double), cmp_double);
+		result.lat_avg_us = sum / n;
+		result.lat_p99_us = lat_us[(n * 99) / 100];
+		result.lat_max_us = lat_us[n - 1];
+	}
+	if (write(resultfd, &result, sizeof(result)) != sizeof(result)) {
+		_exit(1);
+	}
+	ows_evsub_close(sub);
+	_exit(0);
+}
+
+/*
+ * Publish nevents to 1, 2, 4 ... max_subs subscribers & report
+ * publish cost & delivery latency for each subscriber count
+ */
+static int run_bench(int transport, int max_subs, int nevents, int interval_us)
+{
+	int nsubs, i;
+	int readyfd[2], resultfd[2];
+	char ch;
+	int64_t start_ns, publish_ns;
+	struct timespec interval = { 0, interval_us * 1000L };
+	bench_result_t result;
+	double lat_avg, lat_p99, lat_max;
+	unsigned long received, missed;
+
+	printf("%s transport, %d events every %d usec\n",
+	       transport == OWS_EVT_SHM ? "Shared memory" : "Datagram",
+	       nevents, interval_us);
+	printf("subs  publish(ns)  lat avg(us)  lat p99(us)  lat max(us)  received  missed\n");
+
+	for (nsubs = 1; ; nsubs = nsubs * 2 > max_subs ? max_subs : nsubs * 2) {
+		if (ows_event_open(transport) < 0) {
+			return(EXIT_FAILURE);
+		}
+		if (pipe(readyfd) < 0 || pipe(resultfd) < 0) {
+			perror("pipe");
+			return(EXIT_FAILURE);
+		}
+		for (i = 0; i < nsubs; i++) {
+			if (fork() == 0) {
+				bench_subscriber(transport, nevents, readyfd[1], resultfd[1]);
+			}
+		}
+		for (i = 0; i < nsubs; i++) {
+			if (read(readyfd[0], &ch, 1) != 1) {
+				perror("read");
+				return(EXIT_FAILURE);
+			}
+		}
+
+		ows_event_publish(OWS_EV_STATE, OWS_STATE_START, NULL, 0);
+		publish_ns = 0;
+		for (i = 0; i < nevents; i++) {
+			start_ns = ows_event_now_ns();
+			ows_event_publish(OWS_EV_HIT, 0, "144.3900", 0);
+			publish_ns += ows_event_now_ns() - start_ns;
+			nanosleep(&interval, NULL);
+		}
+		ows_event_publish(OWS_EV_STATE, OWS_STATE_STOP, NULL, 0);
+
+		lat_avg = lat_p99 = lat_max = 0.0;
+		received = missed = 0;
+		for (i = 0; i < nsubs; i++) {
+			if (read(resultfd[0], &result, sizeof(result)) != sizeof(result)) {
+				perror("read");
+				return(EXIT_FAILURE);
+			}
+			received += result.received;
+			missed += result.missed;
+			lat_avg += result.lat_avg_us / nsubs;
+			if (result.lat_p99_us > lat_p99) {
+				lat_p99 = result.lat_p99_us;
+			}
+			if (result.lat_max_us > lat_max) {
+				lat_max = result.lat_max_us;
+			}
+		}
+		while (wait(NULL) > 0)
+			;
+		close(readyfd[0]);
+		close(readyfd[1]);
+		close(resultfd[0]);
+		close(resultfd[1]);
+		ows_event_close();
+
+		printf("%4d  %11.0f  %11.1f  %11.1f  %11.1f  %8lu  %6lu\n",
+		       nsubs, (double)publish_ns / nevents, lat_avg, lat_p99,
+		       lat_max, received, missed);
+		if (nsubs == max_subs) {
+			break;
+		}
+	}
+	return(EXIT_SUCCESS);
+}
+
+const char *getprogname(void)
+{
+	return __progname;
+}
+
+/*
+ * Print usage information and exit
+ *  - does not return
+ */
+static void usage(void)
+{
+	printf("Usage:  %s [options]\n", getprogname());
+	printf("  Version: %s\n", PROG_VERSION);
+	printf("  -m  --shm        Use shared memory ring instead of datagram socket\n");
+	printf("  -b  --bench      Benchmark 1 to NUM subscribers (1-%d)\n", OWS_EVENT_MAX_SUBS);
+	printf("  -n  --events     Number of events per benchmark run\n");
+	printf("  -i  --interval   Benchmark usec between events\n");
+	printf("  -V  --verbose    Print verbose messages\n");
+	printf("  -d  --debug      Turn on debug messages\n");
+	printf("  -h  --help       Display this usage info\n");
+
+	exit(EXIT_SUCCESS);
+}
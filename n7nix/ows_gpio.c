@@ -0,0 +1,300 @@
+/*
+ * GPIO control lines of the One Watt Spot
+ *  - uses the gpiochip character device, no wiringPi needed
+ *  - when OWS_GPIO_SIM is set in the environment, line changes are
+ *    written as "line=value" text lines to that file or fifo, which
+ *    lets ows_emu see the module being power cycled
+ *  - the chardev ABI leaves a released line's state undefined, the
+ *    RPi kernel keeps it but mainline pinctrl-bcm2835 makes it an
+ *    input again. ows_gpio_keep hands outputs that did not keep their
+ *    state to sysfs, where they stay until unexported.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "ows_gpio.h"
+
+#define GPIO_MAX_LINES 64
+#define GPIO_SYSFS "/sys/class/gpio"
+
+extern int DebugFlag;
+
+static int chipfd = -1;
+static int simfd = -1;
+static int linefd[GPIO_MAX_LINES];
+static int linevalue[GPIO_MAX_LINES];
+static int lineout[GPIO_MAX_LINES];	/* requested as output */
+
+int ows_gpio_open(void)
+{
+	char *simpath;
+	int i;
+
+	for (i = 0; i < GPIO_MAX_LINES; i++) {
+		linefd[i] = -1;
+	}
+
+	simpath = getenv(OWS_GPIO_SIM_ENV);
+	if (simpath != NULL) {
+		/* non blocking so a fifo without a reader fails right away */
+		simfd = open(simpath, O_WRONLY | O_NONBLOCK | O_APPEND | O_CREAT, 0644);
+		if (simfd < 0) {
+			perror(simpath);
+			return(-1);
+		}
+		if(DebugFlag) {
+			printf("%s: simulating gpio lines on %s\n", __FUNCTION__, simpath);
+		}
+		return(0);
+	}
+
+	chipfd = open(OWS_GPIO_CHIP, O_RDWR | O_CLOEXEC);
+	if (chipfd < 0) {
+		perror(OWS_GPIO_CHIP);
+		return(-1);
+	}
+	return(0);
+}
+
+static int gpio_request(int line, int flags, int value)
+{
+	struct gpiohandle_request req;
+
+	if (line < 0 || line >= GPIO_MAX_LINES) {
+		return(-1);
+	}
+	linevalue[line] = value;
+	lineout[line] = (flags & GPIOHANDLE_REQUEST_OUTPUT) != 0;
+	if (simfd >= 0) {
+		return(lineout[line] ? ows_gpio_set(line, value) : 0);
+	}
+	if (linefd[line] >= 0) {
+		close(linefd[line]);
+		linefd[line] = -1;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.lineoffsets[0] = line;
+	req.lines = 1;
+	req.flags = flags;
+	req.default_values[0] = value;
+	snprintf(req.consumer_label, sizeof(req.consumer_label), "onewattspot");
+
+	if (ioctl(chipfd, GPIO_GET_LINEHANDLE_IOCTL, &req) < 0) {
+		printf("%s: gpio %d request failed: %s\n",
+		       __FUNCTION__, line, strerror(errno));
+		return(-1);
+	}
+	linefd[line] = req.fd;
+	return(0);
+}
+
+/* Claim line as an output & set its initial value */
+int ows_gpio_output(int line, int value)
+{
+	return(gpio_request(line, GPIOHANDLE_REQUEST_OUTPUT, value));
+}
+
+int ows_gpio_input(int line)
+{
+	return(gpio_request(line, GPIOHANDLE_REQUEST_INPUT, 0));
+}
+
+int ows_gpio_set(int line, int value)
+{
+	struct gpiohandle_data data;
+	char simbuf[32];
+	int len;
+
+	if (line < 0 || line >= GPIO_MAX_LINES) {
+		return(-1);
+	}
+	if (simfd >= 0) {
+		linevalue[line] = value;
+		len = snprintf(simbuf, sizeof(simbuf), "%d=%d\n", line, value);
+		return(write(simfd, simbuf, len) == len ? 0 : -1);
+	}
+	if (chipfd < 0 || linefd[line] < 0) {
+		return(-1);
+	}
+
+	memset(&data, 0, sizeof(data));
+	data.values[0] = value;
+	if (ioctl(linefd[line], GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) < 0) {
+		printf("%s: gpio %d set failed: %s\n",
+		       __FUNCTION__, line, strerror(errno));
+		return(-1);
+	}
+	linevalue[line] = value;
+	return(0);
+}
+
+int ows_gpio_get(int line)
+{
+	struct gpiohandle_data data;
+
+	if (line < 0 || line >= GPIO_MAX_LINES) {
+		return(-1);
+	}
+	if (simfd >= 0) {
+		return(linevalue[line]);
+	}
+	if (chipfd < 0 || linefd[line] < 0 ||
+	    ioctl(linefd[line], GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0) {
+		return(-1);
+	}
+	return(data.values[0]);
+}
+
+/*
+ * Release all lines
+ *  - what a released line does is up to the kernel, use
+ *    ows_gpio_keep when outputs must hold after exit
+ */
+void ows_gpio_close(void)
+{
+	int i;
+
+	for (i = 0; i < GPIO_MAX_LINES; i++) {
+		if (linefd[i] >= 0) {
+			close(linefd[i]);
+			linefd[i] = -1;
+		}
+	}
+	if (chipfd >= 0) {
+		close(chipfd);
+		chipfd = -1;
+	}
+	if (simfd >= 0) {
+		close(simfd);
+		simfd = -1;
+	}
+}
+
+/* Number of the first sysfs gpio of the chip with this label, -1 none */
+static int sysfs_base(const char *label)
+{
+	char path[300], buf[64];
+	struct dirent *dent;
+	DIR *dir;
+	FILE *fp;
+	int base = -1;
+
+	dir = opendir(GPIO_SYSFS);
+	if (dir == NULL) {
+		return(-1);
+	}
+	while (base < 0 && (dent = readdir(dir)) != NULL) {
+		if (strncmp(dent->d_name, "gpiochip", 8) != 0) {
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s/label", GPIO_SYSFS, dent->d_name);
+		fp = fopen(path, "r");
+		if (fp == NULL) {
+			continue;
+		}
+		if (fgets(buf, sizeof(buf), fp) != NULL) {
+			buf[strcspn(buf, "\n")] = '\0';
+			if (strcmp(buf, label) == 0) {
+				base = atoi(dent->d_name + 8);
+			}
+		}
+		fclose(fp);
+	}
+	closedir(dir);
+	return(base);
+}
+
+static int sysfs_write(const char *path, const char *value)
+{
+	int fd, len = strlen(value), retcode = 0;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0 || write(fd, value, len) != len) {
+		retcode = -1;
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+	return(retcode);
+}
+
+/* Output through sysfs, direction high or low sets the value glitch free */
+static int sysfs_output(int base, int line, int value)
+{
+	char path[64], num[16];
+
+	snprintf(num, sizeof(num), "%d", base + line);
+	snprintf(path, sizeof(path), "%s/gpio%d/direction", GPIO_SYSFS, base + line);
+	if (access(path, F_OK) < 0 &&
+	    sysfs_write(GPIO_SYSFS "/export", num) < 0) {
+		printf("%s: gpio %d export failed: %s\n", __FUNCTION__, line, strerror(errno));
+		return(-1);
+	}
+	if (sysfs_write(path, value ? "high" : "low") < 0) {
+		printf("%s: gpio %d direction failed: %s\n", __FUNCTION__, line, strerror(errno));
+		return(-1);
+	}
+	return(0);
+}
+
+/*
+ * Release all lines, outputs keep their value after this program exits
+ *  - after release each output is checked, one the kernel turned back
+ *    into an input is set again through sysfs
+ *  returns 0, -1 if an output could not be kept
+ */
+int ows_gpio_keep(void)
+{
+	struct gpiochip_info chip;
+	struct gpioline_info info;
+	int line, base = -1, retcode = 0;
+
+	if (simfd >= 0 || chipfd < 0) {
+		ows_gpio_close();
+		return(0);
+	}
+	for (line = 0; line < GPIO_MAX_LINES; line++) {
+		if (linefd[line] >= 0) {
+			close(linefd[line]);
+			linefd[line] = -1;
+		}
+	}
+	if (ioctl(chipfd, GPIO_GET_CHIPINFO_IOCTL, &chip) < 0) {
+		perror("GPIO_GET_CHIPINFO_IOCTL");
+		ows_gpio_close();
+		return(-1);
+	}
+	for (line = 0; line < GPIO_MAX_LINES; line++) {
+		if (!lineout[line]) {
+			continue;
+		}
+		memset(&info, 0, sizeof(info));
+		info.line_offset = line;
+		if (ioctl(chipfd, GPIO_GET_LINEINFO_IOCTL, &info) == 0 &&
+		    (info.flags & GPIOLINE_FLAG_IS_OUT)) {
+			continue;
+		}
+		if (base < 0) {
+			base = sysfs_base(chip.label);
+		}
+		if(DebugFlag) {
+			printf("%s: gpio %d released to input, sysfs base %d\n",
+			       __FUNCTION__, line, base);
+		}
+		if (base < 0 || sysfs_output(base, line, linevalue[line]) < 0) {
+			printf("%s: gpio %d did not keep its value, no sysfs gpio for %s\n",
+			       __FUNCTION__, line, chip.label);
+			retcode = -1;
+		}
+	}
+	ows_gpio_close();
+	return(retcode);
+}
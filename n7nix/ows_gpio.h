@@ -0,0 +1,25 @@
+/*
+ * GPIO control lines of the One Watt Spot
+ */
+#ifndef OWS_GPIO_H
+#define OWS_GPIO_H
+
+#define OWS_GPIO_CHIP "/dev/gpiochip0"
+/* Write line changes to this file or fifo instead, for the emulator */
+#define OWS_GPIO_SIM_ENV "OWS_GPIO_SIM"
+
+/* BCM line numbers, see ows_gpio_setup.sh */
+#define OWS_GPIO_PTT      23	/* output, 1 = receive */
+#define OWS_GPIO_ACTIVATE 24	/* output, DRA818V PD, 1 = module on */
+#define OWS_GPIO_HIPOWER  27	/* output, DRA818V H/L, 0 = low power */
+#define OWS_GPIO_INPUT    5	/* input */
+
+int ows_gpio_open(void);
+int ows_gpio_output(int line, int value);
+int ows_gpio_input(int line);
+int ows_gpio_set(int line, int value);
+int ows_gpio_get(int line);
+void ows_gpio_close(void);
+int ows_gpio_keep(void);
+
+#endif /* OWS_GPIO_H */
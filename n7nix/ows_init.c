@@ -9,35 +9,21 @@
 #include <getopt.h>
 #include <ctype.h>
 
+#include "ows_serialio.h"
+#include "ows_module.h"
+
 #define PROG_VERSION "1.0"
 /* Links to: /dev/ttyAMA0 on RPi 2, /dev/ttyS0 on RPi 3 */
 #define RPI_SERIAL_DEVICE "/dev/serial0"
 #define SIZE_READBUF 128
 #define SIZE_ATBUF 128
 #define DEFAULT_FREQ 1443900 /* APRS 2M 1200 baud */
-#define DORJI_SIG_DIG 7  /* number of significant digits for frequency */
 
 int DebugFlag=0;
 
-int ows_initserial(const char *pathname);
-int ows_writeserbuf(int fs, char *outstring);
-int ows_readserbuf(int serialfs, char *readbuf, int len_readbuf);
 
 static void usage(void);
 const char *getprogname(void);
-bool check_freq( int freq );
-int padrightzeros(char *str_in, char *str_out);
-int add_decimal( char *str);
-
-/* Structure of DRA818V Group Setting Command */
-typedef struct gsc {
-	int gbw;
-	char tfv[DORJI_SIG_DIG + 2];
-	char rfv[DORJI_SIG_DIG + 2];
-	int tx_ctcss;
-	int sq;
-	int rx_ctcss;
-} gsc_t;
 
 int gverbose_flag = false;
 
@@ -59,9 +45,12 @@ int main(int argc, char *argv[])
 	long int itx_freq, irx_freq;
 	gsc_t gsc; /* instance of group setting command */
 	int dra_volume = 0;
+	char *trace_file = NULL, *replay_file = NULL;
+	char *serial_device = RPI_SERIAL_DEVICE;
+	bool replay_realtime = true;
 
 	/* short options */
-	static const char *short_options = "hVs:v:";
+	static const char *short_options = "hVs:v:t:r:fD:";
 	/* long options */
 	static struct option long_options[] =
 	{
@@ -72,6 +61,10 @@ int main(int argc, char *argv[])
 		{"help",          no_argument,       NULL, 'h'},
 		{"volume",        required_argument, NULL, 'v'},
 		{"squelch",       required_argument, NULL, 's'},
+		{"trace",         required_argument, NULL, 't'},
+		{"replay",        required_argument, NULL, 'r'},
+		{"fast",          no_argument,       NULL, 'f'},
+		{"device",        required_argument, NULL, 'D'},
 		{NULL, no_argument, NULL, 0} /* array termination */
 	};
 
@@ -114,6 +107,10 @@ int main(int argc, char *argv[])
 				} else {
 					usage();
 				}
+				if (!check_volume(dra_volume)) {
+					printf("%s: Volume out of range: %d\n", getprogname(), dra_volume);
+					usage(); /* does not return */
+				}
 
 				printf("DEBUG: volume: %d\n", dra_volume);
 				break;
@@ -126,8 +123,24 @@ int main(int argc, char *argv[])
 				} else {
 					usage();
 				}
+				if (!check_squelch(gsc.sq)) {
+					printf("%s: Squelch out of range: %d\n", getprogname(), gsc.sq);
+					usage(); /* does not return */
+				}
 				printf("DEBUG: squelch: %d\n", gsc.sq);
 				break;
+			case 't':   /* record serial session */
+				trace_file = optarg;
+				break;
+			case 'r':   /* replay recorded serial session */
+				replay_file = optarg;
+				break;
+			case 'f':   /* replay as fast as possible */
+				replay_realtime = false;
+				break;
+			case 'D':   /* serial device */
+				serial_device = optarg;
+				break;
 			case 'h':
 				usage();  /* does not return */
 				break;
@@ -214,7 +227,14 @@ int main(int argc, char *argv[])
 		usage(); /* does not return */
 	}
 
-	uart0fs = ows_initserial(RPI_SERIAL_DEVICE);
+	if (trace_file != NULL && ows_trace_start(trace_file, TRACE_DEFAULT_RECORDS) < 0) {
+		exit(EXIT_FAILURE);
+	}
+	if (replay_file != NULL && ows_replay_start(replay_file, replay_realtime) < 0) {
+		exit(EXIT_FAILURE);
+	}
+
+	uart0fs = ows_initserial(serial_device);
 	if (uart0fs == -1) {
 		exit(EXIT_FAILURE);
 	}
@@ -232,13 +252,13 @@ int main(int argc, char *argv[])
 	for (i=0 ; i < 3; i++) {
 		ows_writeserbuf(uart0fs, "AT+DMOCONNECT");
 		bytecnt=ows_readserbuf(uart0fs, readbuf, len_readbuf);
-		if(bytecnt !=0) {
+		if(bytecnt > 0) {
 			printf("%s: Handshake successful (%d) at index %d\n",
 			       __FUNCTION__, bytecnt, i);
 			break;
 		}
 	}
-	if (bytecnt == 0) {
+	if (bytecnt <= 0) {
 		printf("%s: Failed to initialize DRA818V, exiting\n", __FUNCTION__);
 
 	} else {
@@ -253,74 +273,38 @@ int main(int argc, char *argv[])
 		printf("DEBUG: set group: %s\n", atbuf);
 
 		ows_writeserbuf(uart0fs, atbuf);
-		ows_readserbuf(uart0fs, readbuf, len_readbuf);
+		if (ows_readserbuf(uart0fs, readbuf, len_readbuf) > 0) {
+			ows_state_cache(atbuf);
+		}
 		ows_writeserbuf(uart0fs, "AT+SETFILTER=1,1,1");
-		ows_readserbuf(uart0fs, readbuf, len_readbuf);
+		if (ows_readserbuf(uart0fs, readbuf, len_readbuf) > 0) {
+			ows_state_cache("AT+SETFILTER=1,1,1");
+		}
 
 		snprintf(atbuf, sizeof(atbuf), "AT+DMOSETVOLUME=%d", dra_volume);
 		printf("DEBUG: set volume: %s\n", atbuf);
 
 		/* ows_writeserbuf(uart0fs, "AT+DMOSETVOLUME=3"); */
 		ows_writeserbuf(uart0fs, atbuf);
-		ows_readserbuf(uart0fs, readbuf, len_readbuf);
-	}
-
-	close(uart0fs);
-
-	return 0;
-}
-
-int add_decimal( char *str)
-{
-	char copy_str[16];
-
-	if( strlen(str) > 16 ) {
-		printf("%s: %s: string too long\n", getprogname(), __FUNCTION__);
-		return 0;
-	}
-	memset(copy_str, 0, 16);
-	strncpy(copy_str, str, 16);
-
-	*(str+3) = '.';
-	*(str+4) = '\0';
-
-	strncat(str, copy_str+3, 4);
+		if (ows_readserbuf(uart0fs, readbuf, len_readbuf) > 0) {
+			ows_state_cache(atbuf);
+		}
 
-	if(gverbose_flag) {
-		printf("str2: %s\n", str);
+		/* cached configuration for ows_scan watchdog, a replay
+		 * must not replace the live one */
+		if (replay_file == NULL) {
+			ows_state_save(OWS_STATE_FILE);
+		}
 	}
-	return 1;
-}
 
-int padrightzeros(char *str_in, char *str_out)
-{
-	char zerostr[DORJI_SIG_DIG];
-
-	int numstrsize = strlen(str_in);
-
-	if( numstrsize > DORJI_SIG_DIG ) {
-		strncpy(str_out, str_in, DORJI_SIG_DIG);
-	} else if (numstrsize == DORJI_SIG_DIG ) {
-		strncpy(str_out, str_in, DORJI_SIG_DIG);
-	} else {
-		strcpy(str_out, str_in);
-		memset(zerostr, 0x30, DORJI_SIG_DIG - strlen(str_in));
-		strncat(str_out, zerostr, DORJI_SIG_DIG - strlen(str_in));
+	/* a replay that strays from the trace fails, for regression checks */
+	if (ows_closeserial(uart0fs) < 0) {
+		exit(EXIT_FAILURE);
 	}
 
 	return 0;
 }
 
-bool check_freq( int freq )
-{
-	bool retcode = false;
-
-	if (freq >= 1340000 && freq <= 1740000) {
-		retcode = true;
-	}
-	return (retcode);
-}
-
 const char *getprogname(void)
 {
 	return __progname;
@@ -338,6 +322,10 @@ static void usage(void)
 	printf("  No decimal points used in freq\n");
 	printf("  -v  --volume     Set volume of module (1-8)\n");
 	printf("  -s  --squelch    Set squelch level (0-8)\n");
+	printf("  -t  --trace      Record serial session to trace file\n");
+	printf("  -r  --replay     Replay serial session from trace file\n");
+	printf("  -f  --fast       Replay trace as fast as possible\n");
+	printf("  -D  --device     Serial device (%s)\n", RPI_SERIAL_DEVICE);
 	printf("  -V  --verbose    Print verbose messages\n");
 	printf("  -h  --help       Display this usage info\n");
 
@@ -5,8 +5,8 @@
 scriptname="`basename $0`"
 UDR_INSTALL_LOGFILE="/var/log/udr_install.log"
 
-PKG_LIST="wiringpi"
-FILE_LIST="ows_gpio_setup.sh ows_alsa_setup.sh ows_init btest.sh"
+PKG_LIST="wiringpi libasound2-dev"
+FILE_LIST="ows_gpio_setup.sh ows_alsa_setup.sh ows_init ows_bringup btest.sh"
 
 # ===== function is_pkg_installed
 
@@ -65,13 +65,15 @@ echo "dwc_otg.lpm_enable=0 console=tty1 root=/dev/mmcblk0p2 rootfstype=ext4 elev
 
 echo " === Install required setup programs"
 
-if [ ! -f ows_init ] ; then
+if [ ! -f ows_bringup ] ; then
    make
 fi
 
 for file_name in `echo ${FILE_LIST}` ; do
    cp $file_name /usr/local/bin
 done
+mkdir -p /usr/local/etc
+cp ows_mixer.conf /usr/local/etc
 
 echo
 echo " === setup persistent kiss parameters"
@@ -89,12 +91,11 @@ kiss_params=" -p $PORT -f n -l $TXTAIL -r $PERSIST -s $SLOTTIME -t $TXDELAY"
 sed -r -i "/^#/!s/(kissparms).*/\1$kiss_params\'/" $AX25DEVICE_FILE
 
 # edit systemd service file to run
-#  - ows_gpio_setup.sh, ows_alsa_setup.sh, ows_init
+#  - ows_bringup, does what ows_gpio_setup.sh, ows_alsa_setup.sh
+#    & ows_init did, in parallel
 
 sed -i "/^ExecStartPost=/a \
-ExecStartPost=/bin/bash -c '/usr/local/bin/ows_gpio_setup.sh'\n\
-ExecStartPost=/bin/bash -c '/usr/local/bin/ows_alsa_setup.sh'\n\
-ExecStartPost=/usr/local/bin/ows_init -s 0 -v 4 1443900" $AX25DEVICE_FILE
+ExecStartPost=/usr/local/bin/ows_bringup -s 0 -v 4 1443900" $AX25DEVICE_FILE
 
 echo
 echo " === setup crontab"
@@ -0,0 +1,238 @@
+/*
+ * UDRC mixer profile, amixer batch "sset" lines
+ *  - built with ALSA=yes the profile is applied with the ALSA
+ *    simple mixer API, in process
+ *  - otherwise the profile is piped through a single amixer
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+#include "ows_mixer.h"
+
+extern int DebugFlag;
+
+/* Copy a possibly single quoted token, returns pointer past it */
+static const char *mixer_token(const char *p, char *tok, int len)
+{
+	char quote = 0;
+	int i = 0;
+
+	while (isspace((unsigned char)*p)) {
+		p++;
+	}
+	if (*p == '\'' || *p == '"') {
+		quote = *p++;
+	}
+	while (*p != '\0' && *p != '\n') {
+		if (quote ? *p == quote : isspace((unsigned char)*p)) {
+			if (quote) {
+				p++;
+			}
+			break;
+		}
+		if (i < len - 1) {
+			tok[i++] = *p;
+		}
+		p++;
+	}
+	tok[i] = '\0';
+	return(p);
+}
+
+/*
+ * Parse one profile line: sset 'control name' value
+ *  returns 1 for a sset line, 0 for comments & blank lines, -1 on error
+ */
+int ows_mixer_parse(const char *line, ows_mixer_set_t *pset)
+{
+	char cmd[8];
+
+	while (isspace((unsigned char)*line)) {
+		line++;
+	}
+	if (*line == '#' || *line == '\0') {
+		return(0);
+	}
+	line = mixer_token(line, cmd, sizeof(cmd));
+	if (strcmp(cmd, "sset") != 0) {
+		return(-1);
+	}
+	line = mixer_token(line, pset->name, sizeof(pset->name));
+	mixer_token(line, pset->value, sizeof(pset->value));
+	if (pset->name[0] == '\0' || pset->value[0] == '\0') {
+		return(-1);
+	}
+	return(1);
+}
+
+#ifdef HAVE_ALSA
+
+static int mixer_set_enum(snd_mixer_elem_t *elem, const char *value)
+{
+	char item[OWS_MIXER_VALUE_LEN];
+	int i, nitems, chn;
+
+	nitems = snd_mixer_selem_get_enum_items(elem);
+	for (i = 0; i < nitems; i++) {
+		if (snd_mixer_selem_get_enum_item_name(elem, i, sizeof(item), item) == 0 &&
+		    strcasecmp(item, value) == 0) {
+			for (chn = 0; chn <= SND_MIXER_SCHN_LAST; chn++) {
+				snd_mixer_selem_set_enum_item(elem, chn, i);
+			}
+			return(0);
+		}
+	}
+	return(-1);
+}
+
+static int mixer_set(snd_mixer_elem_t *elem, ows_mixer_set_t *pset)
+{
+	const char *value = pset->value;
+	char *endp;
+	double db;
+	long raw;
+	int sw;
+
+	if (snd_mixer_selem_is_enumerated(elem)) {
+		return(mixer_set_enum(elem, value));
+	}
+
+	if (strcasecmp(value, "on") == 0 || strcasecmp(value, "off") == 0) {
+		sw = strcasecmp(value, "on") == 0;
+		if (snd_mixer_selem_has_playback_switch(elem)) {
+			return(snd_mixer_selem_set_playback_switch_all(elem, sw));
+		}
+		if (snd_mixer_selem_has_capture_switch(elem)) {
+			return(snd_mixer_selem_set_capture_switch_all(elem, sw));
+		}
+		return(-1);
+	}
+
+	db = strtod(value, &endp);
+	if (endp != value && strncasecmp(endp, "dB", 2) == 0) {
+		/* dB values are in hundredths of a dB */
+		if (snd_mixer_selem_has_playback_volume(elem)) {
+			return(snd_mixer_selem_set_playback_dB_all(elem, (long)(db * 100), 0));
+		}
+		if (snd_mixer_selem_has_capture_volume(elem)) {
+			return(snd_mixer_selem_set_capture_dB_all(elem, (long)(db * 100), 0));
+		}
+		return(-1);
+	}
+
+	raw = strtol(value, &endp, 0);
+	if (endp != value && *endp == '\0') {
+		if (snd_mixer_selem_has_playback_volume(elem)) {
+			return(snd_mixer_selem_set_playback_volume_all(elem, raw));
+		}
+		if (snd_mixer_selem_has_capture_volume(elem)) {
+			return(snd_mixer_selem_set_capture_volume_all(elem, raw));
+		}
+	}
+	return(-1);
+}
+
+/*
+ * Apply profile to card
+ *  returns number of controls set, -1 if card or profile not found
+ *  or any control could not be set
+ */
+int ows_mixer_apply(const char *card, const char *profile)
+{
+	snd_mixer_t *mixer;
+	snd_mixer_selem_id_t *sid;
+	snd_mixer_elem_t *elem;
+	ows_mixer_set_t mset;
+	char line[256], hwname[64];
+	FILE *fp;
+	int err, count = 0, failed = 0, lineno = 0;
+
+	fp = fopen(profile, "r");
+	if (fp == NULL) {
+		perror(profile);
+		return(-1);
+	}
+
+	snprintf(hwname, sizeof(hwname), "hw:CARD=%s", card);
+	if ((err = snd_mixer_open(&mixer, 0)) < 0 ||
+	    (err = snd_mixer_attach(mixer, hwname)) < 0 ||
+	    (err = snd_mixer_selem_register(mixer, NULL, NULL)) < 0 ||
+	    (err = snd_mixer_load(mixer)) < 0) {
+		printf("%s: mixer %s: %s\n", __FUNCTION__, hwname, snd_strerror(err));
+		fclose(fp);
+		return(-1);
+	}
+	snd_mixer_selem_id_alloca(&sid);
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		if (ows_mixer_parse(line, &mset) <= 0) {
+			continue;
+		}
+		snd_mixer_selem_id_set_index(sid, 0);
+		snd_mixer_selem_id_set_name(sid, mset.name);
+		elem = snd_mixer_find_selem(mixer, sid);
+		if (elem == NULL || mixer_set(elem, &mset) < 0) {
+			printf("%s: %s line %d: can not set '%s' to %s\n",
+			       __FUNCTION__, profile, lineno, mset.name, mset.value);
+			failed++;
+			continue;
+		}
+		count++;
+	}
+	fclose(fp);
+	snd_mixer_close(mixer);
+
+	if(DebugFlag) {
+		printf("%s: set %d controls on %s\n", __FUNCTION__, count, hwname);
+	}
+	return(failed ? -1 : count);
+}
+
+#else /* HAVE_ALSA */
+
+/*
+ * Apply profile to card with one amixer batch
+ *  returns number of controls set, -1 on error
+ */
+int ows_mixer_apply(const char *card, const char *profile)
+{
+	ows_mixer_set_t mset;
+	char line[256], cmd[128];
+	FILE *fp, *amixer;
+	int count = 0;
+
+	fp = fopen(profile, "r");
+	if (fp == NULL) {
+		perror(profile);
+		return(-1);
+	}
+	snprintf(cmd, sizeof(cmd), "amixer -q -c %s -s", card);
+	amixer = popen(cmd, "w");
+	if (amixer == NULL) {
+		perror("amixer");
+		fclose(fp);
+		return(-1);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (ows_mixer_parse(line, &mset) > 0) {
+			fprintf(amixer, "sset '%s' '%s'\n", mset.name, mset.value);
+			count++;
+		}
+	}
+	fclose(fp);
+	if (pclose(amixer) != 0) {
+		return(-1);
+	}
+	return(count);
+}
+
+#endif /* HAVE_ALSA */
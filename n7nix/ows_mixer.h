@@ -0,0 +1,21 @@
+/*
+ * UDRC mixer profile, amixer batch "sset" lines
+ */
+#ifndef OWS_MIXER_H
+#define OWS_MIXER_H
+
+#define OWS_MIXER_CARD "udrc"
+#define OWS_MIXER_PROFILE "/usr/local/etc/ows_mixer.conf"
+#define OWS_MIXER_NAME_LEN 64
+#define OWS_MIXER_VALUE_LEN 32
+
+/* One sset line */
+typedef struct ows_mixer_set {
+	char name[OWS_MIXER_NAME_LEN];
+	char value[OWS_MIXER_VALUE_LEN];
+} ows_mixer_set_t;
+
+int ows_mixer_parse(const char *line, ows_mixer_set_t *pset);
+int ows_mixer_apply(const char *card, const char *profile);
+
+#endif /* OWS_MIXER_H */
@@ -0,0 +1,422 @@
+/*
+ * DRA818V module control: cached configuration & health watchdog
+ *
+ * Every reply to a normal command counts as a keepalive, so a busy
+ * scanner costs nothing extra. A handshake, which does not key the
+ * transmitter, is only sent after WD_KEEPALIVE_MS without a command.
+ *
+ * After WD_MISS_LIMIT missed replies the module is declared hung, it
+ * is power cycled with the Activate line & only the cached
+ * configuration commands are replayed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <termios.h>
+
+#include "ows_serialio.h"
+#include "ows_gpio.h"
+#include "ows_module.h"
+
+#define SIZE_READBUF 128
+#define SIZE_ATBUF 128
+
+extern int DebugFlag;
+
+static struct {
+	char cmd[OWS_STATE_MAX][SIZE_ATBUF];
+	int count;
+} state;
+
+static struct {
+	bool enabled;
+	int timeout_ms;
+	int misses;
+	double last_reply_ms;
+	ows_wd_stats_t stats;
+} wd;
+
+double ows_module_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0);
+}
+
+void ows_module_sleep_ms(int msec)
+{
+	struct timespec ts = { msec / 1000, (msec % 1000) * 1000000L };
+
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+		;
+}
+
+/*
+ * Insert the decimal point after the MHz digits, 1443900 -> 144.3900
+ *  - str must hold DORJI_FREQ_SIZE
+ */
+int add_decimal(char *str)
+{
+	char copy_str[16];
+
+	if (strlen(str) >= sizeof(copy_str)) {
+		printf("%s: string too long\n", __FUNCTION__);
+		return 0;
+	}
+	snprintf(copy_str, sizeof(copy_str), "%s", str);
+	/* '.', 4 digits of kHz & terminator */
+	snprintf(str + 3, DORJI_FREQ_SIZE - 3, ".%.4s", copy_str + 3);
+
+	if(DebugFlag) {
+		printf("str2: %s\n", str);
+	}
+	return 1;
+}
+
+/* Frequency digits to DORJI_SIG_DIG, 14439 -> 1443900 */
+int padrightzeros(char *str_in, char *str_out)
+{
+	int numstrsize = strlen(str_in);
+
+	if (numstrsize >= DORJI_SIG_DIG) {
+		snprintf(str_out, DORJI_SIG_DIG + 1, "%.*s", DORJI_SIG_DIG, str_in);
+	} else {
+		snprintf(str_out, DORJI_SIG_DIG + 1, "%s%.*s",
+			 str_in, DORJI_SIG_DIG - numstrsize, "0000000");
+	}
+	return 0;
+}
+
+/* 134 - 174 MHz, the DRA818V range */
+bool check_freq(int freq)
+{
+	return(freq >= 1340000 && freq <= 1740000);
+}
+
+/*
+ * Frequency as for ows_init, 14439 or 1443900 is 144.3900 MHz
+ *  returns 0, -1 not all digits or out of the DRA818V range
+ */
+int parse_mhz(const char *arg, double *pmhz)
+{
+	char digits[DORJI_SIG_DIG + 1], freq[DORJI_FREQ_SIZE];
+	int len;
+
+	len = strspn(arg, "0123456789");
+	if (len == 0 || len > DORJI_SIG_DIG || arg[len] != '\0') {
+		return(-1);
+	}
+	snprintf(digits, sizeof(digits), "%s", arg);
+	padrightzeros(digits, freq);
+	if (!check_freq(atoi(freq))) {
+		printf("%s: frequency out of range: %s\n", __FUNCTION__, arg);
+		return(-1);
+	}
+	add_decimal(freq);
+	*pmhz = atof(freq);
+	return(0);
+}
+
+/* AT+DMOSETVOLUME 1 - 8 */
+bool check_volume(int volume)
+{
+	return(volume >= 1 && volume <= 8);
+}
+
+/* AT+DMOSETGROUP SQ 0 - 8 */
+bool check_squelch(int sq)
+{
+	return(sq >= 0 && sq <= 8);
+}
+
+/*
+ * Remember a configuration command, replaces a cached command
+ * of the same type ie. everything before the '='
+ */
+void ows_state_cache(const char *atcmd)
+{
+	size_t keylen = strcspn(atcmd, "=");
+	int i;
+
+	for (i = 0; i < state.count; i++) {
+		if (strncmp(state.cmd[i], atcmd, keylen) == 0 &&
+		    (state.cmd[i][keylen] == '=' || state.cmd[i][keylen] == '\0')) {
+			break;
+		}
+	}
+	if (i == OWS_STATE_MAX) {
+		printf("%s: state cache full, dropping %s\n", __FUNCTION__, atcmd);
+		return;
+	}
+	snprintf(state.cmd[i], SIZE_ATBUF, "%s", atcmd);
+	if (i == state.count) {
+		state.count++;
+	}
+}
+
+/* Get cached command starting with prefix, NULL if none */
+const char *ows_state_get(const char *prefix)
+{
+	int i;
+
+	for (i = 0; i < state.count; i++) {
+		if (strncmp(state.cmd[i], prefix, strlen(prefix)) == 0) {
+			return(state.cmd[i]);
+		}
+	}
+	return(NULL);
+}
+
+int ows_state_save(const char *pathname)
+{
+	FILE *fp;
+	int i;
+
+	fp = fopen(pathname, "w");
+	if (fp == NULL) {
+		perror(pathname);
+		return(-1);
+	}
+	for (i = 0; i < state.count; i++) {
+		fprintf(fp, "%s\n", state.cmd[i]);
+	}
+	fclose(fp);
+	return(0);
+}
+
+int ows_state_load(const char *pathname)
+{
+	FILE *fp;
+	char line[SIZE_ATBUF];
+
+	fp = fopen(pathname, "r");
+	if (fp == NULL) {
+		perror(pathname);
+		return(-1);
+	}
+	state.count = 0;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (strncmp(line, "AT+", 3) == 0) {
+			ows_state_cache(line);
+		}
+	}
+	fclose(fp);
+
+	if(DebugFlag) {
+		printf("%s: %d cached commands from %s\n",
+		       __FUNCTION__, state.count, pathname);
+	}
+	return(state.count);
+}
+
+/*
+ * Replay cached configuration commands
+ *  returns 0 when every command got a reply
+ */
+int ows_state_restore(int fd)
+{
+	char readbuf[SIZE_READBUF];
+	char atbuf[SIZE_ATBUF];
+	int i;
+
+	for (i = 0; i < state.count; i++) {
+		snprintf(atbuf, sizeof(atbuf), "%s", state.cmd[i]);
+		ows_writeserbuf(fd, atbuf);
+		if (ows_readserbuf(fd, readbuf, sizeof(readbuf)) <= 0) {
+			return(-1);
+		}
+	}
+	return(0);
+}
+
+/*
+ * Handshake command, used to check if the module works normally
+ *  returns reply byte count, 0 when module did not answer
+ */
+int ows_module_handshake(int fd, int tries)
+{
+	char readbuf[SIZE_READBUF];
+	int i, bytecnt = 0;
+
+	for (i = 0; i < tries; i++) {
+		ows_writeserbuf(fd, "AT+DMOCONNECT");
+		bytecnt = ows_readserbuf(fd, readbuf, sizeof(readbuf));
+		if (bytecnt != 0) {
+			break;
+		}
+	}
+	if (bytecnt > 0) {
+		wd.last_reply_ms = ows_module_now_ms();
+		wd.misses = 0;
+	}
+	return(bytecnt);
+}
+
+/*
+ * Send a command & wait for the reply, with watchdog accounting
+ *  returns reply byte count, 0 on timeout, -1 when serial device closed
+ */
+int ows_module_command(int fd, char *atcmd, char *readbuf, int len_readbuf)
+{
+	int bytecnt;
+
+	ows_writeserbuf(fd, atcmd);
+	bytecnt = ows_readserbuf(fd, readbuf, len_readbuf);
+	if (bytecnt > 0) {
+		wd.last_reply_ms = ows_module_now_ms();
+		wd.misses = 0;
+		return(bytecnt);
+	}
+	if (bytecnt < 0 || !wd.enabled) {
+		return(bytecnt);
+	}
+
+	wd.misses++;
+	if (wd.misses >= WD_MISS_LIMIT) {
+		ows_watchdog_recover(fd);
+	}
+	return(0);
+}
+
+/*
+ * Power down the module with the Activate line, settings are lost
+ */
+int ows_module_powerdown(void)
+{
+	return(ows_gpio_set(OWS_GPIO_ACTIVATE, 0));
+}
+
+/*
+ * Power up the module, wait for a handshake & replay the cached
+ * configuration
+ *  returns 0 when the module is ready, -1 if it did not answer
+ */
+int ows_module_wake(int fd, int tries)
+{
+	if (ows_gpio_set(OWS_GPIO_ACTIVATE, 1) < 0) {
+		return(-1);
+	}
+	/* drop anything the module sent while going down */
+	tcflush(fd, TCIFLUSH);
+
+	if (ows_module_handshake(fd, tries) > 0 &&
+	    ows_state_restore(fd) == 0) {
+		return(0);
+	}
+	return(-1);
+}
+
+/*
+ * Send a handshake if nothing has been heard from the module for a while
+ */
+int ows_module_keepalive(int fd)
+{
+	char readbuf[SIZE_READBUF];
+
+	if (!wd.enabled || ows_module_now_ms() - wd.last_reply_ms < WD_KEEPALIVE_MS) {
+		return(0);
+	}
+	return(ows_module_command(fd, "AT+DMOCONNECT", readbuf, sizeof(readbuf)));
+}
+
+/*
+ * Enable watchdog, a reply not seen within timeout_ms is a miss
+ *  - the configuration to restore is loaded from OWS_STATE_FILE
+ */
+int ows_watchdog_start(int timeout_ms)
+{
+	if (ows_gpio_open() < 0 ||
+	    ows_gpio_output(OWS_GPIO_ACTIVATE, 1) < 0) {
+		printf("%s: Can not control module Activate line\n", __FUNCTION__);
+		return(-1);
+	}
+	if (ows_state_load(OWS_STATE_FILE) <= 0) {
+		printf("%s: No cached configuration, run ows_init first\n", __FUNCTION__);
+	}
+	ows_setreadtimeout(timeout_ms);
+
+	memset(&wd.stats, 0, sizeof(wd.stats));
+	wd.timeout_ms = timeout_ms;
+	wd.misses = 0;
+	wd.last_reply_ms = ows_module_now_ms();
+	wd.enabled = true;
+
+	printf("Watchdog: reply timeout %d ms, worst case detect %d ms\n",
+	       timeout_ms, timeout_ms * WD_MISS_LIMIT);
+	return(0);
+}
+
+/*
+ * Power cycle module with the Activate line & replay cached configuration
+ *  returns 0 when module is back
+ */
+int ows_watchdog_recover(int fd)
+{
+	ows_wd_stats_t *ps = &wd.stats;
+	double hung_ms = ows_module_now_ms();
+	int i, retcode = -1;
+
+	ps->hangs++;
+	ps->detect_ms = hung_ms - wd.last_reply_ms;
+	ps->detect_ms_sum += ps->detect_ms;
+	if (ps->detect_ms > ps->detect_ms_max) {
+		ps->detect_ms_max = ps->detect_ms;
+	}
+	printf("Watchdog: module not responding for %.0f ms, power cycling\n",
+	       ps->detect_ms);
+
+	for (i = 0; i < WD_RECOVER_TRIES; i++) {
+		ows_module_powerdown();
+		ows_module_sleep_ms(WD_POWER_OFF_MS);
+		if (ows_module_wake(fd, WD_READY_TRIES) == 0) {
+			retcode = 0;
+			break;
+		}
+	}
+
+	ps->recover_ms = ows_module_now_ms() - hung_ms;
+	if (retcode == 0) {
+		ps->recoveries++;
+		ps->recover_ms_sum += ps->recover_ms;
+		if (ps->recover_ms > ps->recover_ms_max) {
+			ps->recover_ms_max = ps->recover_ms;
+		}
+		printf("Watchdog: module recovered in %.0f ms\n", ps->recover_ms);
+	} else {
+		printf("Watchdog: module did not recover after %d power cycles\n",
+		       WD_RECOVER_TRIES);
+	}
+	wd.misses = 0;
+	wd.last_reply_ms = ows_module_now_ms();
+
+	return(retcode);
+}
+
+ows_wd_stats_t *ows_watchdog_stats(void)
+{
+	return(&wd.stats);
+}
+
+void ows_watchdog_report(void)
+{
+	ows_wd_stats_t *ps = &wd.stats;
+
+	if (!wd.enabled) {
+		return;
+	}
+	printf("Watchdog: %d hangs, %d recoveries\n", ps->hangs, ps->recoveries);
+	if (ps->hangs > 0) {
+		printf("  time to detect:  avg %.0f ms, max %.0f ms\n",
+		       ps->detect_ms_sum / ps->hangs, ps->detect_ms_max);
+	}
+	if (ps->recoveries > 0) {
+		printf("  time to recover: avg %.0f ms, max %.0f ms\n",
+		       ps->recover_ms_sum / ps->recoveries, ps->recover_ms_max);
+	}
+}
@@ -0,0 +1,73 @@
+/*
+ * DRA818V module control: cached configuration, power & health watchdog
+ */
+#ifndef OWS_MODULE_H
+#define OWS_MODULE_H
+
+#include <stdbool.h>
+
+#define DORJI_SIG_DIG 7  /* number of significant digits for frequency */
+#define DORJI_FREQ_SIZE (DORJI_SIG_DIG + 2)	/* 144.3900 & terminator */
+
+/* Configuration commands sent by ows_init, one per line */
+#define OWS_STATE_FILE "/tmp/ows_state"
+#define OWS_STATE_MAX 8
+
+#define WD_MISS_LIMIT      2	/* missed replies before module is declared hung */
+#define WD_POWER_OFF_MS    100	/* Activate line low time when power cycling */
+#define WD_READY_TRIES     10	/* handshakes to wait for module after power up */
+#define WD_RECOVER_TRIES   3	/* power cycles before giving up */
+#define WD_KEEPALIVE_MS    2000	/* idle time before a handshake is sent */
+
+typedef struct ows_wd_stats {
+	int hangs;		/* times module was declared hung */
+	int recoveries;		/* times module came back */
+	double detect_ms;	/* last reply to declared hung */
+	double detect_ms_max;
+	double detect_ms_sum;
+	double recover_ms;	/* declared hung to configuration restored */
+	double recover_ms_max;
+	double recover_ms_sum;
+} ows_wd_stats_t;
+
+/* Structure of DRA818V Group Setting Command */
+typedef struct gsc {
+	int gbw;
+	char tfv[DORJI_FREQ_SIZE];
+	char rfv[DORJI_FREQ_SIZE];
+	int tx_ctcss;
+	int sq;
+	int rx_ctcss;
+} gsc_t;
+
+/* Frequency strings, 1443900 <-> 144.3900 */
+int add_decimal(char *str);
+int padrightzeros(char *str_in, char *str_out);
+bool check_freq(int freq);
+int parse_mhz(const char *arg, double *pmhz);
+bool check_volume(int volume);
+bool check_squelch(int sq);
+
+/* Cached configuration */
+void ows_state_cache(const char *atcmd);
+const char *ows_state_get(const char *prefix);
+int ows_state_save(const char *pathname);
+int ows_state_load(const char *pathname);
+int ows_state_restore(int fd);
+
+/* Module commands */
+double ows_module_now_ms(void);
+void ows_module_sleep_ms(int msec);
+int ows_module_handshake(int fd, int tries);
+int ows_module_command(int fd, char *atcmd, char *readbuf, int len_readbuf);
+int ows_module_keepalive(int fd);
+int ows_module_powerdown(void);
+int ows_module_wake(int fd, int tries);
+
+/* Watchdog */
+int ows_watchdog_start(int timeout_ms);
+int ows_watchdog_recover(int fd);
+ows_wd_stats_t *ows_watchdog_stats(void);
+void ows_watchdog_report(void);
+
+#endif /* OWS_MODULE_H */
@@ -0,0 +1,234 @@
+/*
+ * Scan list planning from a measured retune latency model
+ *
+ * On a line any cycle through all the channels moves the synthesizer
+ * at least twice the span of the list, so channels are visited in
+ * frequency order. A channel with a revisit target shorter than the
+ * cycle is visited more than once: the cycle is split into rounds,
+ * each channel appears in as many rounds as it needs & rounds sweep
+ * up and down alternately so the turn around costs nothing.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "ows_plan.h"
+
+extern int DebugFlag;
+
+int ows_plan_load_model(const char *pathname, ows_plan_model_t *pmodel)
+{
+	FILE *fp;
+	char line[128];
+	int found = 0;
+
+	memset(pmodel, 0, sizeof(*pmodel));
+	fp = fopen(pathname, "r");
+	if (fp == NULL) {
+		return(-1);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		found += sscanf(line, "base_ms %lf", &pmodel->base_ms);
+		found += sscanf(line, "per_mhz_ms %lf", &pmodel->per_mhz_ms);
+		sscanf(line, "samples %d", &pmodel->samples);
+	}
+	fclose(fp);
+	return(found == 2 ? 0 : -1);
+}
+
+int ows_plan_save_model(const char *pathname, ows_plan_model_t *pmodel)
+{
+	FILE *fp;
+
+	fp = fopen(pathname, "w");
+	if (fp == NULL) {
+		perror(pathname);
+		return(-1);
+	}
+	fprintf(fp, "# ows_retune model, settle_ms = base_ms + per_mhz_ms * |delta MHz|\n");
+	fprintf(fp, "base_ms %.2f\n", pmodel->base_ms);
+	fprintf(fp, "per_mhz_ms %.3f\n", pmodel->per_mhz_ms);
+	fprintf(fp, "samples %d\n", pmodel->samples);
+	fclose(fp);
+	return(0);
+}
+
+double ows_plan_retune_ms(ows_plan_model_t *pmodel, double from_mhz, double to_mhz)
+{
+	if (from_mhz == to_mhz) {
+		return(0.0);
+	}
+	return(pmodel->base_ms + pmodel->per_mhz_ms * fabs(to_mhz - from_mhz));
+}
+
+/*
+ * Walk the cycle twice & find each channel's longest time unwatched,
+ * end of one dwell to the start of the next
+ *  returns number of channels missing their revisit target
+ */
+int ows_plan_cost(ows_plan_model_t *pmodel, ows_plan_chan_t *chans, int nchans,
+		  const int *seq, int len, double dwell_ms,
+		  double *poverhead_ms, double *pcycle_ms)
+{
+	double last_end[OWS_PLAN_MAX], t = 0.0, overhead = 0.0, gap;
+	int i, k, ch, prev, missing = 0;
+
+	for (i = 0; i < nchans; i++) {
+		chans[i].visits = 0;
+		chans[i].max_gap_ms = 0.0;
+		last_end[i] = -1.0;
+	}
+	if (len == 0) {
+		return(nchans);
+	}
+	prev = seq[len - 1];
+	for (k = 0; k < 2 * len; k++) {
+		ch = seq[k % len];
+		t += ows_plan_retune_ms(pmodel, chans[prev].mhz, chans[ch].mhz);
+		if (k < len) {
+			overhead += ows_plan_retune_ms(pmodel, chans[prev].mhz, chans[ch].mhz);
+			chans[ch].visits++;
+		}
+		if (last_end[ch] >= 0.0 && k >= len) {
+			gap = t - last_end[ch];
+			if (gap > chans[ch].max_gap_ms) {
+				chans[ch].max_gap_ms = gap;
+			}
+		}
+		t += dwell_ms;
+		last_end[ch] = t;
+		prev = ch;
+	}
+	for (i = 0; i < nchans; i++) {
+		if (chans[i].visits == 0 ||
+		    (chans[i].revisit_ms > 0.0 && chans[i].max_gap_ms > chans[i].revisit_ms)) {
+			missing++;
+		}
+	}
+	*poverhead_ms = overhead;
+	*pcycle_ms = t / 2.0;
+	return(missing);
+}
+
+/* qsort has no context argument */
+static ows_plan_chan_t *sort_chans;
+
+static int compare_mhz(const void *a, const void *b)
+{
+	double fa = sort_chans[*(const int *)a].mhz;
+	double fb = sort_chans[*(const int *)b].mhz;
+
+	return(fa < fb ? -1 : fa > fb);
+}
+
+/* Rounds in frequency order, up then down, channel i in rounds[i] of them */
+static int plan_rounds(const int *order, const int *rounds, int nchans, int *seq)
+{
+	int maxr = 1, k, j, i, len = 0;
+
+	for (i = 0; i < nchans; i++) {
+		if (rounds[i] > maxr) {
+			maxr = rounds[i];
+		}
+	}
+	for (k = 0; k < maxr; k++) {
+		for (j = 0; j < nchans; j++) {
+			int pos = (k & 1) ? nchans - 1 - j : j;
+			/* stagger channels so rounds are about the same size */
+			int phase = (pos * maxr) / nchans;
+
+			i = order[pos];
+			/* spread a channel's visits evenly over the rounds */
+			if ((k * rounds[i] + phase) / maxr == ((k + 1) * rounds[i] + phase) / maxr) {
+				continue;
+			}
+			/* back to back visits are one long dwell */
+			if (len > 0 && seq[len - 1] == i) {
+				continue;
+			}
+			if (len == OWS_PLAN_MAX) {
+				return(-1);
+			}
+			seq[len++] = i;
+		}
+	}
+	return(len);
+}
+
+/*
+ * Plan one scan cycle, seq gets indexes into chans
+ *  returns cycle length, channels still missing their target have
+ *  max_gap_ms > revisit_ms
+ */
+int ows_plan_build(ows_plan_model_t *pmodel, ows_plan_chan_t *chans, int nchans,
+		   double dwell_ms, int *seq)
+{
+	int order[OWS_PLAN_MAX], rounds[OWS_PLAN_MAX], trial[OWS_PLAN_MAX];
+	double overhead, cycle, ratio, worst_ratio, excess, best_excess = 0.0, best_overhead = 0.0;
+	int i, len, missing, best_len = 0, worst, tries;
+
+	if (nchans <= 0 || nchans > OWS_PLAN_MAX) {
+		return(-1);
+	}
+	for (i = 0; i < nchans; i++) {
+		order[i] = i;
+		rounds[i] = 1;
+	}
+	sort_chans = chans;
+	qsort(order, nchans, sizeof(int), compare_mhz);
+
+	for (tries = 0; tries < OWS_PLAN_MAX * 4; tries++) {
+		len = plan_rounds(order, rounds, nchans, trial);
+		if (len < 0) {
+			break;
+		}
+		missing = ows_plan_cost(pmodel, chans, nchans, trial, len, dwell_ms,
+					&overhead, &cycle);
+		/* time over target, then retune time */
+		excess = 0.0;
+		for (i = 0; i < nchans; i++) {
+			if (chans[i].revisit_ms > 0.0 && chans[i].max_gap_ms > chans[i].revisit_ms) {
+				excess += chans[i].max_gap_ms - chans[i].revisit_ms;
+			}
+		}
+		if (best_len == 0 || excess < best_excess ||
+		    (excess == best_excess && overhead < best_overhead)) {
+			best_excess = excess;
+			best_overhead = overhead;
+			best_len = len;
+			memcpy(seq, trial, len * sizeof(int));
+		}
+		if (missing == 0) {
+			break;
+		}
+		/* one more round for the channel furthest over its target */
+		worst = -1;
+		worst_ratio = 1.0;
+		for (i = 0; i < nchans; i++) {
+			if (chans[i].revisit_ms <= 0.0) {
+				continue;
+			}
+			ratio = chans[i].max_gap_ms / chans[i].revisit_ms;
+			if (ratio > worst_ratio) {
+				worst_ratio = ratio;
+				worst = i;
+			}
+		}
+		if (worst < 0) {
+			break;
+		}
+		rounds[worst]++;
+		if(DebugFlag) {
+			printf("%s: %.4f MHz gap %.0f ms, target %.0f ms, now %d rounds\n",
+			       __FUNCTION__, chans[worst].mhz, chans[worst].max_gap_ms,
+			       chans[worst].revisit_ms, rounds[worst]);
+		}
+	}
+	/* leave results for the plan returned */
+	ows_plan_cost(pmodel, chans, nchans, seq, best_len, dwell_ms, &overhead, &cycle);
+	return(best_len);
+}
@@ -0,0 +1,35 @@
+/*
+ * Scan list planning from a measured retune latency model
+ */
+#ifndef OWS_PLAN_H
+#define OWS_PLAN_H
+
+/* Written by ows_retune -c, one per module */
+#define OWS_PLAN_MODEL "/usr/local/etc/ows_retune.conf"
+#define OWS_PLAN_MAX 64		/* visits in one planned cycle */
+
+/* settle_ms = base_ms + per_mhz_ms * |delta MHz| */
+typedef struct ows_plan_model {
+	double base_ms;
+	double per_mhz_ms;
+	int samples;
+} ows_plan_model_t;
+
+typedef struct ows_plan_chan {
+	double mhz;
+	double revisit_ms;	/* max time between visits, 0 no target */
+	/* filled in by ows_plan_build & ows_plan_cost */
+	int visits;
+	double max_gap_ms;
+} ows_plan_chan_t;
+
+int ows_plan_load_model(const char *pathname, ows_plan_model_t *pmodel);
+int ows_plan_save_model(const char *pathname, ows_plan_model_t *pmodel);
+double ows_plan_retune_ms(ows_plan_model_t *pmodel, double from_mhz, double to_mhz);
+int ows_plan_cost(ows_plan_model_t *pmodel, ows_plan_chan_t *chans, int nchans,
+		  const int *seq, int len, double dwell_ms,
+		  double *poverhead_ms, double *pcycle_ms);
+int ows_plan_build(ows_plan_model_t *pmodel, ows_plan_chan_t *chans, int nchans,
+		   double dwell_ms, int *seq);
+
+#endif /* OWS_PLAN_H */
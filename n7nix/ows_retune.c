@@ -0,0 +1,378 @@
+/*
+ * Retune latency of the DRA818V & scan list planning
+ *  - characterize: retune between every pair of frequencies & time
+ *    until S+ replies are stable, fit a per module latency model
+ *  - plan: order & repeat the scan list to cut retune time per cycle
+ *    while meeting each channel's revisit target
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+
+#include "ows_serialio.h"
+#include "ows_module.h"
+#include "ows_plan.h"
+
+#define PROG_VERSION "1.0"
+/* Links to: /dev/ttyAMA0 on RPi 2, /dev/ttyS0 on RPi 3 */
+#define RPI_SERIAL_DEVICE "/dev/serial0"
+#define SIZE_READBUF 128
+#define SIZE_ATBUF 128
+
+#define DEFAULT_REPEAT 5	/* retunes measured per frequency pair */
+#define DEFAULT_STABLE 5	/* identical S+ replies in a row that count as settled */
+#define DEFAULT_DWELL_SEC 5	/* ows_scan -s */
+#define SETTLE_MAX_MS 3000	/* give up waiting for stable replies */
+#define REPLY_TIMEOUT_MS 500
+
+static void usage(void);
+const char *getprogname(void);
+
+int DebugFlag = false;
+int gverbose_flag = false;
+
+extern char *__progname;
+
+static int stable_count = DEFAULT_STABLE;
+
+/*
+ * Frequency as for ows_init, 14439 or 1443900 is 144.3900 MHz,
+ * optionally followed by @<revisit sec>
+ */
+static int parse_chan(const char *arg, ows_plan_chan_t *pchan)
+{
+	char freq[DORJI_SIG_DIG + 2];
+	const char *at;
+
+	memset(pchan, 0, sizeof(*pchan));
+	/* frequency before the optional @sec */
+	at = strchr(arg, '@');
+	snprintf(freq, sizeof(freq), "%.*s",
+		 at != NULL ? (int)(at - arg) : (int)strlen(arg), arg);
+	if (parse_mhz(freq, &pchan->mhz) < 0) {
+		return(-1);
+	}
+	if (at != NULL) {
+		pchan->revisit_ms = atof(at + 1) * 1000.0;
+	}
+	return(0);
+}
+
+/*
+ * Send S+ until stable_count identical replies in a row
+ *  returns ms from the first S+ to the first reply of the stable run,
+ *  -1 if the replies never settled
+ */
+static double settle_ms(int fd, double mhz)
+{
+	char atbuf[SIZE_ATBUF], readbuf[SIZE_READBUF];
+	double t0, now, run_start = 0.0;
+	int sig, last = -1, run = 0;
+
+	snprintf(atbuf, sizeof(atbuf), "S+%.4f", mhz);
+	t0 = ows_module_now_ms();
+	do {
+		if (ows_module_command(fd, atbuf, readbuf, sizeof(readbuf)) <= 0) {
+			return(-1.0);
+		}
+		now = ows_module_now_ms();
+		sig = atoi(&readbuf[2]);
+		if (sig != last) {
+			run = 0;
+			run_start = now;
+			last = sig;
+		}
+		if (++run >= stable_count) {
+			return(run_start - t0);
+		}
+	} while (now - t0 < SETTLE_MAX_MS);
+	return(-1.0);
+}
+
+/* Fit overhead = a + b * delta, least squares */
+static void fit_line(const double *x, const double *y, int n, double *pa, double *pb, double *pr2)
+{
+	double mx = 0.0, my = 0.0, sxx = 0.0, sxy = 0.0, syy = 0.0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		mx += x[i];
+		my += y[i];
+	}
+	mx /= n;
+	my /= n;
+	for (i = 0; i < n; i++) {
+		sxx += (x[i] - mx) * (x[i] - mx);
+		sxy += (x[i] - mx) * (y[i] - my);
+		syy += (y[i] - my) * (y[i] - my);
+	}
+	*pb = sxx > 0.0 ? sxy / sxx : 0.0;
+	*pa = my - *pb * mx;
+	*pr2 = sxx > 0.0 && syy > 0.0 ? (sxy * sxy) / (sxx * syy) : 0.0;
+}
+
+static int characterize(const char *device, ows_plan_chan_t *chans, int nchans,
+			int repeat, const char *model_file)
+{
+	ows_plan_model_t model;
+	double *delta, *overhead, base = 0.0, ms, r2;
+	int fd, a, b, r, n = 0, nbase = 0, failed = 0, i, j, count;
+	double sum, max;
+
+	fd = ows_initserial(device);
+	if (fd == -1) {
+		return(-1);
+	}
+	ows_setreadtimeout(REPLY_TIMEOUT_MS);
+
+	delta = malloc(nchans * nchans * repeat * sizeof(double));
+	overhead = malloc(nchans * nchans * repeat * sizeof(double));
+	if (delta == NULL || overhead == NULL) {
+		close(fd);
+		return(-1);
+	}
+
+	/* no retune, stable replies on the same frequency */
+	for (a = 0; a < nchans; a++) {
+		settle_ms(fd, chans[a].mhz);
+		for (r = 0; r < repeat; r++) {
+			ms = settle_ms(fd, chans[a].mhz);
+			if (ms >= 0.0) {
+				base += ms;
+				nbase++;
+			}
+		}
+	}
+	base = nbase > 0 ? base / nbase : 0.0;
+	printf("No retune: %.1f ms to %d stable replies\n", base, stable_count);
+
+	for (r = 0; r < repeat; r++) {
+		for (a = 0; a < nchans; a++) {
+			for (b = 0; b < nchans; b++) {
+				if (a == b) {
+					continue;
+				}
+				settle_ms(fd, chans[a].mhz);
+				ms = settle_ms(fd, chans[b].mhz);
+				if (ms < 0.0) {
+					failed++;
+					continue;
+				}
+				delta[n] = fabs(chans[b].mhz - chans[a].mhz);
+				overhead[n] = ms - base;
+				if (gverbose_flag) {
+					printf("  %.4f -> %.4f: %.0f ms\n",
+					       chans[a].mhz, chans[b].mhz, ms);
+				}
+				n++;
+			}
+		}
+	}
+	close(fd);
+
+	if (n == 0) {
+		printf("No retunes settled, %d failed\n", failed);
+		free(delta);
+		free(overhead);
+		return(-1);
+	}
+
+	/* per step size */
+	printf("%10s %6s %9s %9s\n", "delta MHz", "count", "avg ms", "max ms");
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < i; j++) {
+			if (fabs(delta[j] - delta[i]) < 0.00005) {
+				break;
+			}
+		}
+		if (j < i) {
+			continue;
+		}
+		sum = max = 0.0;
+		count = 0;
+		for (j = i; j < n; j++) {
+			if (fabs(delta[j] - delta[i]) < 0.00005) {
+				sum += overhead[j];
+				max = overhead[j] > max ? overhead[j] : max;
+				count++;
+			}
+		}
+		printf("%10.4f %6d %9.1f %9.1f\n", delta[i], count, sum / count, max);
+	}
+
+	fit_line(delta, overhead, n, &model.base_ms, &model.per_mhz_ms, &r2);
+	model.samples = n;
+	printf("Model: retune %.1f ms + %.2f ms per MHz, r^2 %.2f, %d retunes, %d failed\n",
+	       model.base_ms, model.per_mhz_ms, r2, n, failed);
+	free(delta);
+	free(overhead);
+	return(ows_plan_save_model(model_file, &model));
+}
+
+static void print_cycle(const char *title, ows_plan_model_t *pmodel, ows_plan_chan_t *chans,
+			int nchans, const int *seq, int len, double dwell_ms)
+{
+	double overhead, cycle;
+	int i, missing;
+
+	missing = ows_plan_cost(pmodel, chans, nchans, seq, len, dwell_ms, &overhead, &cycle);
+	printf("%s: retune %.0f ms per %.1f sec cycle, %d channels over target\n ",
+	       title, overhead, cycle / 1000.0, missing);
+	for (i = 0; i < len; i++) {
+		printf(" %.4f", chans[seq[i]].mhz);
+	}
+	printf("\n");
+	if (gverbose_flag) {
+		for (i = 0; i < nchans; i++) {
+			printf("  %.4f: %d visits, unwatched max %.1f sec, target %.1f sec\n",
+			       chans[i].mhz, chans[i].visits, chans[i].max_gap_ms / 1000.0,
+			       chans[i].revisit_ms / 1000.0);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	/* For command line parsing */
+	int next_option;
+	int option_index = 0; /* getopt_long stores the option index here. */
+
+	char *serial_device = RPI_SERIAL_DEVICE;
+	char *model_file = OWS_PLAN_MODEL;
+	bool do_characterize = false;
+	int repeat = DEFAULT_REPEAT, dwell_sec = DEFAULT_DWELL_SEC;
+	ows_plan_chan_t chans[OWS_PLAN_MAX];
+	ows_plan_model_t model;
+	int seq[OWS_PLAN_MAX], nchans = 0, len, i;
+
+	/* short options */
+	static const char *short_options = "hVdcD:M:n:k:s:";
+	/* long options */
+	static struct option long_options[] =
+	{
+		/* These options set a flag. */
+		{"verbose",     no_argument,  &gverbose_flag, true},
+		{"debug",       no_argument,  &DebugFlag, true},
+		/* These options don't set a flag.
+		We distinguish them by their indices. */
+		{"help",        no_argument,       NULL, 'h'},
+		{"characterize", no_argument,      NULL, 'c'},
+		{"device",      required_argument, NULL, 'D'},
+		{"model",       required_argument, NULL, 'M'},
+		{"repeat",      required_argument, NULL, 'n'},
+		{"stable",      required_argument, NULL, 'k'},
+		{"scan",        required_argument, NULL, 's'},
+		{NULL, no_argument, NULL, 0} /* array termination */
+	};
+
+	opterr = 0;
+	option_index = 0;
+	next_option = getopt_long (argc, argv, short_options,
+				   long_options, &option_index);
+
+	while( next_option != -1 ) {
+
+		switch (next_option) {
+			case 0:   /* long option without a short arg */
+				break;
+			case 'c': do_characterize = true; break;
+			case 'D': serial_device = optarg; break;
+			case 'M': model_file = optarg; break;
+			case 'n': repeat = atoi(optarg); break;
+			case 'k': stable_count = atoi(optarg); break;
+			case 's': dwell_sec = atoi(optarg); break;
+			case 'V':   /* set verbose flag */
+				gverbose_flag = true;
+				break;
+			case 'd':
+				DebugFlag = true;
+				break;
+			case 'h':
+				usage();  /* does not return */
+				break;
+			case '?':
+				if (isprint (optopt)) {
+					fprintf (stderr, "%s: Unknown option `-%c'.\n",
+						getprogname(), optopt);
+				} else {
+					fprintf (stderr,"%s: Unknown option character `\\x%x'.\n",
+						getprogname(), optopt);
+				}
+				/* fall through */
+			default:
+				usage();  /* does not return */
+				break;
+		}
+
+		next_option = getopt_long (argc, argv, short_options,
+					   long_options, &option_index);
+	}
+
+	for (; optind < argc && nchans < OWS_PLAN_MAX; optind++) {
+		if (parse_chan(argv[optind], &chans[nchans]) < 0) {
+			printf("Parse error for frequency: %s\n", argv[optind]);
+			usage();  /* does not return */
+		}
+		nchans++;
+	}
+	if (nchans < 2) {
+		printf("Need at least 2 frequencies\n");
+		usage();  /* does not return */
+	}
+
+	if (do_characterize) {
+		exit(characterize(serial_device, chans, nchans, repeat, model_file) < 0 ?
+		     EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	if (ows_plan_load_model(model_file, &model) < 0) {
+		printf("No retune model in %s, run %s -c first\n", model_file, getprogname());
+		exit(EXIT_FAILURE);
+	}
+	printf("Model: retune %.1f ms + %.2f ms per MHz from %d retunes\n",
+	       model.base_ms, model.per_mhz_ms, model.samples);
+
+	/* command line order, as ows_scan does without -P */
+	for (i = 0; i < nchans; i++) {
+		seq[i] = i;
+	}
+	print_cycle("List order", &model, chans, nchans, seq, nchans, dwell_sec * 1000.0);
+
+	len = ows_plan_build(&model, chans, nchans, dwell_sec * 1000.0, seq);
+	print_cycle("Planned", &model, chans, nchans, seq, len, dwell_sec * 1000.0);
+
+	return(0);
+}
+
+const char *getprogname(void)
+{
+	return __progname;
+}
+
+/*
+ * Print usage information and exit
+ *  - does not return
+ */
+static void usage(void)
+{
+	printf("Usage:  %s [options] freq[@revisit sec] freq[@revisit sec] ...\n", getprogname());
+	printf("  Version: %s\n", PROG_VERSION);
+	printf("  -c  --characterize  Measure retune time between the frequencies & save the model\n");
+	printf("  -n  --repeat        Retunes per frequency pair (%d)\n", DEFAULT_REPEAT);
+	printf("  -k  --stable        Identical S+ replies in a row that count as settled (%d)\n", DEFAULT_STABLE);
+	printf("  -D  --device        Serial device (%s)\n", RPI_SERIAL_DEVICE);
+	printf("  -M  --model         Retune model file (%s)\n", OWS_PLAN_MODEL);
+	printf("  -s  --scan          Dwell on each frequency in sec, as ows_scan -s (%d)\n", DEFAULT_DWELL_SEC);
+	printf("  -V  --verbose       Print verbose messages\n");
+	printf("  -d  --debug         Turn on debug messages\n");
+	printf("  -h  --help          Display this usage info\n");
+
+	exit(EXIT_SUCCESS);
+}
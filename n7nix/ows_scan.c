@@ -10,6 +10,13 @@
 #include <getopt.h>
 #include <ctype.h>
 #include <time.h>
+#include <signal.h>
+
+#include "ows_serialio.h"
+#include "ows_event.h"
+#include "ows_module.h"
+#include "ows_plan.h"
+#include "ows_squelch.h"
 
 #define PROG_VERSION "1.0"
 /* Links to: /dev/ttyAMA0 on RPi 2, /dev/ttyS0 on RPi 3 */
@@ -29,33 +36,37 @@
  *  145.070
  */
 #define DEFAULT_FREQ "1443900"
-#define DORJI_SIG_DIG 7  /* number of significant digits for frequency */
-#define DORJI_FREQ_SIZE (DORJI_SIG_DIG + 2)
 
 #define SLEEP_PACE .5 /* unsigned int */
 #define MAX_FREQ_COUNT 15
 
-int ows_initserial(const char *pathname);
-int ows_writeserbuf(int fs, char *outstring);
-int ows_readserbuf(int serialfs, char *readbuf, int len_readbuf);
 
 static void usage(void);
 int ms_sleep(int mswait);
 const char *getprogname(void);
-bool check_freq( int freq );
 char *parse_freq(char *pScanFreq);
-int padrightzeros(char *str_in, char *str_out);
-int add_decimal( char *str);
+static void publish_stop(void);
+static void watchdog_stop(void);
+static int scan_plan(const char *model_file, char **freqlist, double *revisit_ms,
+		     int count, int scancheck_period, int *plan);
+static int scan_squelch(const char *squelch_file, char **freqlist, int count, int *squelch);
 
 int DebugFlag = false;
 int gverbose_flag = false;
 
+static volatile sig_atomic_t scan_done;
+
+static void scan_sighandler(int sig)
+{
+	scan_done = 1;
+}
+
 extern char *__progname;
 
 int main(int argc, char *argv[])
 {
 	/* For command line parsing */
-	int next_option, i;
+	int next_option, i, k;
 	int option_index = 0; /* getopt_long stores the option index here. */
 
 	int uart0fs;
@@ -74,12 +85,25 @@ int main(int argc, char *argv[])
 	time_t start_time, current_time;
 	char *pTimeBuf;
 	int timeBufLen;
+	char *trace_file = NULL, *replay_file = NULL;
+	bool replay_realtime = true;
+	int event_transports = 0;
+	char *serial_device = RPI_SERIAL_DEVICE;
+	int watchdog_timeout = 0;
+	bool chan_busy[MAX_FREQ_COUNT];
+	double revisit_ms[MAX_FREQ_COUNT+1];
+	bool plan_flag = false;
+	char *plan_model = OWS_PLAN_MODEL;
+	int plan[OWS_PLAN_MAX], plan_len;
+	bool squelch_flag = false;
+	char *squelch_file = OWS_SQUELCH_CONF;
+	int squelch[MAX_FREQ_COUNT+1], global_sq = -1, cur_sq = -1;
 
 	/* initialize frequency list */
 	freqlist[0] = NULL;
 
 	/* short options */
-	static const char *short_options = "hVdw:s:";
+	static const char *short_options = "hVdw:s:t:r:fe:D:W:PM:qQ:";
 	/* long options */
 	static struct option long_options[] =
 	{
@@ -91,6 +115,16 @@ int main(int argc, char *argv[])
 		{"help",          no_argument,       NULL, 'h'},
 		{"wait",        required_argument, NULL, 'w'},
 		{"scan",        required_argument, NULL, 's'},
+		{"trace",       required_argument, NULL, 't'},
+		{"replay",      required_argument, NULL, 'r'},
+		{"fast",        no_argument,       NULL, 'f'},
+		{"events",      required_argument, NULL, 'e'},
+		{"device",      required_argument, NULL, 'D'},
+		{"watchdog",    required_argument, NULL, 'W'},
+		{"plan",        no_argument,       NULL, 'P'},
+		{"model",       required_argument, NULL, 'M'},
+		{"squelch",     no_argument,       NULL, 'q'},
+		{"squelch-file", required_argument, NULL, 'Q'},
 		{NULL, no_argument, NULL, 0} /* array termination */
 	};
 
@@ -136,6 +170,48 @@ int main(int argc, char *argv[])
 					printf("DEBUG: scan check period: %d\n", scancheck_period);
 				}
 				break;
+			case 't':   /* record serial session */
+				trace_file = optarg;
+				break;
+			case 'r':   /* replay recorded serial session */
+				replay_file = optarg;
+				break;
+			case 'f':   /* replay as fast as possible */
+				replay_realtime = false;
+				break;
+			case 'e':   /* publish scan events */
+				if (strcmp(optarg, "dgram") == 0) {
+					event_transports = OWS_EVT_DGRAM;
+				} else if (strcmp(optarg, "shm") == 0) {
+					event_transports = OWS_EVT_SHM;
+				} else if (strcmp(optarg, "both") == 0) {
+					event_transports = OWS_EVT_DGRAM | OWS_EVT_SHM;
+				} else {
+					usage();  /* does not return */
+				}
+				break;
+			case 'D':   /* serial device */
+				serial_device = optarg;
+				break;
+			case 'W':   /* enable watchdog, reply timeout in msec */
+				watchdog_timeout = atoi(optarg);
+				if (watchdog_timeout <= 0) {
+					usage();  /* does not return */
+				}
+				break;
+			case 'P':   /* reorder scan list with the retune model */
+				plan_flag = true;
+				break;
+			case 'M':   /* retune model file */
+				plan_model = optarg;
+				break;
+			case 'q':   /* per channel squelch from ows_sqtune */
+				squelch_flag = true;
+				break;
+			case 'Q':   /* per channel squelch file */
+				squelch_file = optarg;
+				squelch_flag = true;
+				break;
 			case 'V':   /* set verbose flag */
 				gverbose_flag = true;
 				break;
@@ -183,17 +259,31 @@ int main(int argc, char *argv[])
 
 	/* Everything else on command line is considered a frequency
 	 * to scan */
+	memset(revisit_ms, 0, sizeof(revisit_ms));
 	while(optind < argc) {
-		char *prx_freq, *prxm_freq;
+		char *prx_freq, *prxm_freq, *previsit;
+		double revisit = 0.0;
 
 		prx_freq = argv[optind];
 		if(DebugFlag) {
 			printf("DEBUG: arg chk tx: %s\n", prx_freq);
 		}
+		if (freqlist_index == MAX_FREQ_COUNT) {
+			printf("Too many frequencies at %s, %d max\n",
+			       prx_freq, MAX_FREQ_COUNT);
+			exit(EXIT_FAILURE);
+		}
+		/* optional revisit target in sec for -P, freq@sec */
+		previsit = strchr(prx_freq, '@');
+		if (previsit != NULL) {
+			*previsit++ = '\0';
+			revisit = atof(previsit) * 1000.0;
+		}
 
 		prxm_freq = parse_freq(prx_freq);
 		if (prxm_freq != NULL) {
 			freqlist[freqlist_index] = prxm_freq;
+			revisit_ms[freqlist_index] = revisit;
 			freqlist_index++;
 
 			if(gverbose_flag) {
@@ -207,14 +297,59 @@ int main(int argc, char *argv[])
 		optind++;
 	}
 
-	uart0fs = ows_initserial(RPI_SERIAL_DEVICE);
+	if (trace_file != NULL && ows_trace_start(trace_file, TRACE_DEFAULT_RECORDS) < 0) {
+		exit(EXIT_FAILURE);
+	}
+	if (replay_file != NULL && ows_replay_start(replay_file, replay_realtime) < 0) {
+		exit(EXIT_FAILURE);
+	}
+
+	uart0fs = ows_initserial(serial_device);
 	if (uart0fs == -1) {
 		exit(EXIT_FAILURE);
 	}
 
-	printf("Scanning these frequencies:\n");
+	if (watchdog_timeout > 0) {
+		if (ows_watchdog_start(watchdog_timeout) < 0) {
+			exit(EXIT_FAILURE);
+		}
+		atexit(watchdog_stop);
+	}
+
+	if (event_transports != 0) {
+		if (ows_event_open(event_transports) < 0) {
+			exit(EXIT_FAILURE);
+		}
+		atexit(publish_stop);
+	}
+	memset(chan_busy, 0, sizeof(chan_busy));
+
+	/*
+	 * exit cleanly so trace, events & watchdog stats get written,
+	 * subscribers wait for the STOP event sent on exit
+	 */
+	signal(SIGINT, scan_sighandler);
+	signal(SIGTERM, scan_sighandler);
+	signal(SIGHUP, scan_sighandler);
+
 	for (i = 0; i < freqlist_index; i++) {
-		printf ("  %s ", freqlist[i]);
+		plan[i] = i;
+	}
+	plan_len = freqlist_index;
+	if (plan_flag) {
+		plan_len = scan_plan(plan_model, freqlist, revisit_ms, freqlist_index,
+				     scancheck_period, plan);
+	}
+
+	if (squelch_flag) {
+		global_sq = scan_squelch(squelch_file, freqlist, freqlist_index, squelch);
+		squelch_flag = global_sq >= 0;
+		cur_sq = global_sq;
+	}
+
+	printf("Scanning these frequencies:\n");
+	for (k = 0; k < plan_len; k++) {
+		printf ("  %s ", freqlist[plan[k]]);
 	}
 	printf("\n");
 
@@ -226,17 +361,35 @@ int main(int argc, char *argv[])
 	pTimeBuf[timeBufLen-1] = '\0';
 	printf( "START time: %s with scan: wait %d ms, check %d sec... running\n",
 		  pTimeBuf, scanwait_period, scancheck_period );
+	ows_event_publish(OWS_EV_STATE, OWS_STATE_START, NULL, 0);
 
-	while(1) {
+	while(!scan_done) {
 
-		for (i = 0; i < freqlist_index; i++) {
+		for (k = 0; k < plan_len && !scan_done; k++) {
+			i = plan[k];
 			snprintf(atbuf, sizeof(atbuf), "S+%s", freqlist[i]);
+			/* module has one squelch, set it with each retune */
+			if (squelch_flag && squelch[i] != cur_sq &&
+			    ows_squelch_set(uart0fs, squelch[i]) == 0) {
+				cur_sq = squelch[i];
+			}
 
 			start_time = current_time = time(NULL);
-
-			while(difftime(current_time, start_time) < scancheck_period) {
-				ows_writeserbuf(uart0fs, atbuf);
-				ows_readserbuf(uart0fs, readbuf, len_readbuf);
+			ows_event_publish(OWS_EV_STATE, OWS_STATE_RETUNE, freqlist[i], 0);
+
+			while(difftime(current_time, start_time) < scancheck_period && !scan_done) {
+				retcode = ows_module_command(uart0fs, atbuf, readbuf, len_readbuf);
+				if (retcode < 0) {
+					/* serial device gone or end of replay */
+					printf("Serial device closed, exiting\n");
+					exit(ows_closeserial(uart0fs) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+				}
+				current_time = time(NULL);
+				if (retcode == 0) {
+					/* no reply, don't report as a signal */
+					ms_sleep(scanwait_period);
+					continue;
+				}
 				retcode = atoi(&readbuf[2]);
 
 				if(DebugFlag) {
@@ -248,14 +401,123 @@ int main(int argc, char *argv[])
 				if(retcode != 1) {
 					printf("packet[%d] on freq: %s at %s",
 					       retcode, freqlist[i], ctime(&current_time));
+					if (!chan_busy[i]) {
+						ows_event_publish(OWS_EV_HIT, 0, freqlist[i], retcode);
+						chan_busy[i] = true;
+					}
+				} else if (chan_busy[i]) {
+					ows_event_publish(OWS_EV_CLEAR, 0, freqlist[i], retcode);
+					chan_busy[i] = false;
 				}
 				ms_sleep(scanwait_period);
+				ows_module_keepalive(uart0fs);
+			}
+			/* leaving a busy channel */
+			if (chan_busy[i]) {
+				ows_event_publish(OWS_EV_CLEAR, 0, freqlist[i], 1);
+				chan_busy[i] = false;
 			}
 		}
 	}
+	/* leave the module as ows_init set it */
+	if (squelch_flag && cur_sq != global_sq) {
+		ows_squelch_set(uart0fs, global_sq);
+	}
+	if (ows_closeserial(uart0fs) < 0) {
+		exit(EXIT_FAILURE);
+	}
+
 	return(0);
 }
 
+static void publish_stop(void)
+{
+	ows_event_publish(OWS_EV_STATE, OWS_STATE_STOP, NULL, 0);
+	if (gverbose_flag) {
+		ows_event_stats();
+	}
+	ows_event_close();
+}
+
+static void watchdog_stop(void)
+{
+	ows_watchdog_report();
+}
+
+/*
+ * Order & repeat the scan list to cut retune time, meeting revisit targets
+ *  returns plan length, list order if there is no retune model
+ */
+static int scan_plan(const char *model_file, char **freqlist, double *revisit_ms,
+		     int count, int scancheck_period, int *plan)
+{
+	ows_plan_model_t model;
+	ows_plan_chan_t chans[MAX_FREQ_COUNT];
+	double overhead, cycle;
+	int i, len;
+
+	if (ows_plan_load_model(model_file, &model) < 0) {
+		printf("No retune model in %s, run ows_retune -c first, scanning in list order\n",
+		       model_file);
+		return(count);
+	}
+	for (i = 0; i < count; i++) {
+		chans[i].mhz = atof(freqlist[i]);
+		chans[i].revisit_ms = revisit_ms[i];
+	}
+	len = ows_plan_build(&model, chans, count, scancheck_period * 1000.0, plan);
+	if (len <= 0) {
+		for (i = 0; i < count; i++) {
+			plan[i] = i;
+		}
+		return(count);
+	}
+	ows_plan_cost(&model, chans, count, plan, len, scancheck_period * 1000.0,
+		      &overhead, &cycle);
+	printf("Scan plan: %d visits, retune %.0f ms per %.1f sec cycle\n",
+	       len, overhead, cycle / 1000.0);
+	for (i = 0; i < count; i++) {
+		if (chans[i].revisit_ms > 0.0 && chans[i].max_gap_ms > chans[i].revisit_ms) {
+			printf("  %s: unwatched %.1f sec, over %.1f sec target\n",
+			       freqlist[i], chans[i].max_gap_ms / 1000.0,
+			       chans[i].revisit_ms / 1000.0);
+		}
+	}
+	return(len);
+}
+
+/*
+ * Squelch for each channel, tuned by ows_sqtune or the global level
+ *  returns squelch the module is set to, -1 if ows_init has not run
+ */
+static int scan_squelch(const char *squelch_file, char **freqlist, int count, int *squelch)
+{
+	ows_squelch_chan_t chans[OWS_SQUELCH_CHANS];
+	int nchans, global_sq, i;
+
+	if (ows_state_load(OWS_STATE_FILE) <= 0 ||
+	    (global_sq = ows_squelch_cached()) < 0) {
+		printf("No cached configuration in %s, run ows_init first, using module squelch\n",
+		       OWS_STATE_FILE);
+		return(-1);
+	}
+	nchans = ows_squelch_load(squelch_file, chans, OWS_SQUELCH_CHANS);
+	if (nchans < 0) {
+		printf("No squelch levels in %s, run ows_sqtune first\n", squelch_file);
+		nchans = 0;
+	}
+	printf("Squelch:");
+	for (i = 0; i < count; i++) {
+		squelch[i] = ows_squelch_lookup(chans, nchans, atof(freqlist[i]));
+		if (squelch[i] < 0) {
+			squelch[i] = global_sq;
+		}
+		printf("  %s %d", freqlist[i], squelch[i]);
+	}
+	printf("\n");
+	return(global_sq);
+}
+
 int ms_sleep(int mswait)
 {
 	struct timeval tv;
@@ -310,57 +572,6 @@ char *parse_freq(char *pScanFreq)
 	return(prxm_freq);
 }
 
-int add_decimal( char *str)
-{
-	char copy_str[16];
-
-	if( strlen(str) > 16 ) {
-		printf("%s: %s: string too long\n", getprogname(), __FUNCTION__);
-		return 0;
-	}
-	memset(copy_str, 0, 16);
-	strncpy(copy_str, str, 16);
-
-	*(str+3) = '.';
-	*(str+4) = '\0';
-
-	strncat(str, copy_str+3, 4);
-
-	if(DebugFlag) {
-		printf("str2: %s\n", str);
-	}
-	return 1;
-}
-
-int padrightzeros(char *str_in, char *str_out)
-{
-	char zerostr[DORJI_SIG_DIG];
-
-	int numstrsize = strlen(str_in);
-
-	if( numstrsize > DORJI_SIG_DIG ) {
-		strncpy(str_out, str_in, DORJI_SIG_DIG);
-	} else if (numstrsize == DORJI_SIG_DIG ) {
-		strncpy(str_out, str_in, DORJI_SIG_DIG);
-	} else {
-		strcpy(str_out, str_in);
-		memset(zerostr, 0x30, DORJI_SIG_DIG - strlen(str_in));
-		strncat(str_out, zerostr, DORJI_SIG_DIG - strlen(str_in));
-	}
-
-	return 0;
-}
-
-bool check_freq( int freq )
-{
-	bool retcode = false;
-
-	if (freq >= 1340000 && freq <= 1740000) {
-		retcode = true;
-	}
-	return (retcode);
-}
-
 const char *getprogname(void)
 {
 	return __progname;
@@ -376,6 +587,16 @@ static void usage(void)
 	printf("  Version: %s\n", PROG_VERSION);
 	printf("  -w  --wait	   Set scan period in msec (500 = 1/2sec)\n");
 	printf("  -s  --scan       Set scan period in sec\n");
+	printf("  -t  --trace      Record serial session to trace file\n");
+	printf("  -r  --replay     Replay serial session from trace file\n");
+	printf("  -f  --fast       Replay trace as fast as possible\n");
+	printf("  -e  --events     Publish scan events: dgram, shm or both\n");
+	printf("  -W  --watchdog   Power cycle hung module, reply timeout in msec\n");
+	printf("  -P  --plan       Reorder scan list with the retune model, freq@sec sets a revisit target\n");
+	printf("  -M  --model      Retune model file (%s)\n", OWS_PLAN_MODEL);
+	printf("  -q  --squelch    Set each channel's squelch from ows_sqtune on retune\n");
+	printf("  -Q  --squelch-file Squelch file (%s)\n", OWS_SQUELCH_CONF);
+	printf("  -D  --device     Serial device (%s)\n", RPI_SERIAL_DEVICE);
 	printf("  -V  --verbose    Print verbose messages\n");
 	printf("  -d  --debug      Turn on debug messages\n");
 	printf("  -h  --help       Display this usage info\n");
@@ -0,0 +1,591 @@
+/*
+ * Offline scan policy simulator
+ *  - replays per channel activity, from ows_scan logs, an activity
+ *    file or synthetic Poisson traffic, against the ows_scan loop
+ *  - runs a grid of wait, check & scan list size settings on all
+ *    cores & reports detection probability and latency
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#define PROG_VERSION "1.0"
+#define MAX_CHANNELS 15		/* MAX_FREQ_COUNT in ows_scan */
+#define MAX_GRID 64		/* values per grid axis */
+#define FREQ_LEN 12
+
+#define DEFAULT_BAUD 9600
+#define DEFAULT_REPLY_MS 20	/* module turn around, measure with ows_scan -d */
+#define DEFAULT_HOURS 1.0
+#define DEFAULT_RATE 1.0	/* packets per minute per channel */
+#define DEFAULT_PACKET_MS 600	/* 1200 baud APRS packet with preamble */
+#define DEFAULT_MERGE_SEC 3
+#define MS_SLEEP_EXTRA_MS 1000	/* ms_sleep always sleeps tv_sec = 1 */
+#define REPLY_LEN 5		/* S=0\r\n */
+
+static void usage(void);
+const char *getprogname(void);
+
+int DebugFlag = false;
+int gverbose_flag = false;
+
+extern char *__progname;
+
+/* One transmission, sec */
+typedef struct xmit {
+	double start;
+	double len;
+} xmit_t;
+
+/* One channel's transmissions, sorted by start */
+typedef struct channel {
+	char freq[FREQ_LEN];
+	xmit_t *xmit;
+	int count;
+	int alloc;
+} channel_t;
+
+/* One grid point & its results */
+typedef struct policy {
+	int wait_ms;
+	int check_sec;
+	int nchan;
+	bool fixed_sleep;
+
+	int total;
+	int detected;
+	long samples;
+	double lat_avg;
+	double lat_p95;
+	double lat_max;
+} policy_t;
+
+/* Timing model shared by all workers */
+typedef struct model {
+	double byte_sec;	/* 10 bits per byte, 8N1 */
+	double reply_sec;
+	double duration;	/* sec */
+	double phase;		/* start offset within a second */
+} model_t;
+
+static channel_t channels[MAX_CHANNELS];
+static int nchannels;
+static model_t model;
+static policy_t *policies;
+static int npolicies;
+static int next_policy;
+
+/* Frequencies ows_scan was tested with */
+static const char *default_freqs[] = {
+	"144.3900", "144.3500", "144.9900", "144.9500", "145.6300",
+	"145.6900", "144.9700", "145.0500", "145.0700"
+};
+
+/* Also sorts xmit_t by start */
+static int compare_double(const void *a, const void *b)
+{
+	double da = *(const double *)a, db = *(const double *)b;
+
+	return(da < db ? -1 : da > db);
+}
+
+static channel_t *channel_find(const char *freq)
+{
+	int i;
+
+	for (i = 0; i < nchannels; i++) {
+		if (strcmp(channels[i].freq, freq) == 0) {
+			return(&channels[i]);
+		}
+	}
+	if (nchannels == MAX_CHANNELS) {
+		return(NULL);
+	}
+	snprintf(channels[nchannels].freq, FREQ_LEN, "%s", freq);
+	return(&channels[nchannels++]);
+}
+
+static int channel_add(channel_t *pchan, double start, double len)
+{
+	if (pchan->count == pchan->alloc) {
+		pchan->alloc = pchan->alloc ? pchan->alloc * 2 : 256;
+		pchan->xmit = realloc(pchan->xmit, pchan->alloc * sizeof(xmit_t));
+		if (pchan->xmit == NULL) {
+			printf("%s: out of memory\n", __FUNCTION__);
+			return(-1);
+		}
+	}
+	pchan->xmit[pchan->count].start = start;
+	pchan->xmit[pchan->count].len = len;
+	pchan->count++;
+	return(0);
+}
+
+/* Poisson arrivals, packet length uniform +-50% around packet_ms */
+static void synth_traffic(int count, double rate_min, int packet_ms, unsigned int seed)
+{
+	channel_t *pchan;
+	double t, len;
+	int i;
+
+	srand48(seed);
+	for (i = 0; i < count && i < (int)(sizeof(default_freqs) / sizeof(char *)); i++) {
+		pchan = channel_find(default_freqs[i]);
+		t = 0.0;
+		while (1) {
+			t += -log(1.0 - drand48()) * 60.0 / rate_min;
+			len = packet_ms * (0.5 + drand48()) / 1000.0;
+			if (t + len >= model.duration) {
+				break;
+			}
+			channel_add(pchan, t, len);
+			t += len;
+		}
+	}
+}
+
+/*
+ * Read activity, one per line:
+ *   ows_scan output: packet[0] on freq: 144.3900 at Mon Oct 19 12:00:01 2026
+ *     hits on a channel less than merge_sec apart are one transmission
+ *   activity file: <freq> <start sec> <length ms>
+ */
+static int load_activity(const char *pathname, int merge_sec)
+{
+	FILE *fp;
+	char line[256], freq[FREQ_LEN];
+	double last[MAX_CHANNELS], t0 = -1.0, start, len;
+	struct tm tm;
+	channel_t *pchan;
+	bool hit;
+	char *p;
+	int sig, lineno = 0, i;
+
+	fp = fopen(pathname, "r");
+	if (fp == NULL) {
+		perror(pathname);
+		return(-1);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		if (sscanf(line, "packet[%d] on freq: %11s at", &sig, freq) == 2) {
+			p = strstr(line, " at ");
+			memset(&tm, 0, sizeof(tm));
+			tm.tm_isdst = -1;
+			if (p == NULL || strptime(p + 4, "%a %b %d %H:%M:%S %Y", &tm) == NULL) {
+				printf("%s: line %d: bad time\n", pathname, lineno);
+				continue;
+			}
+			start = mktime(&tm);
+			len = 1.0;	/* time() resolution */
+			hit = true;
+		} else if (sscanf(line, "%11s %lf %lf", freq, &start, &len) == 3 &&
+			   isdigit((unsigned char)freq[0])) {
+			len /= 1000.0;
+			hit = false;
+		} else {
+			continue;
+		}
+		if (t0 < 0.0) {
+			t0 = start;
+		}
+		start -= t0;
+		pchan = channel_find(freq);
+		if (pchan == NULL) {
+			printf("%s: more than %d channels\n", pathname, MAX_CHANNELS);
+			fclose(fp);
+			return(-1);
+		}
+		i = pchan - channels;
+		/* extend the last transmission for repeated ows_scan hits */
+		if (hit && pchan->count > 0 && start - last[i] < merge_sec) {
+			xmit_t *px = &pchan->xmit[pchan->count - 1];
+
+			px->len = start + len - px->start;
+		} else if (channel_add(pchan, start, len) < 0) {
+			fclose(fp);
+			return(-1);
+		}
+		last[i] = start;
+		if (start + len + 1.0 > model.duration) {
+			model.duration = start + len + 1.0;
+		}
+	}
+	fclose(fp);
+	for (i = 0; i < nchannels; i++) {
+		qsort(channels[i].xmit, channels[i].count, sizeof(xmit_t), compare_double);
+	}
+	return(nchannels);
+}
+
+/*
+ * Step through the ows_scan loop for one policy
+ *  - time() granularity of the dwell check
+ *  - S+ command out, module turn around, S= reply in at baud rate
+ *  - the dwell check uses current_time from before the sleep
+ */
+static void simulate(policy_t *pp)
+{
+	int cmd_len[MAX_CHANNELS], first[MAX_CHANNELS];
+	double *latency;
+	char *seen;
+	double t = model.phase, t_cmd, sleep_sec, sum = 0.0;
+	long start_sec, cur_sec;
+	int i, j, base, total = 0;
+
+	for (i = 0; i < pp->nchan; i++) {
+		/* S+<freq>\r\n */
+		cmd_len[i] = strlen(channels[i].freq) + 4;
+		first[i] = 0;
+		total += channels[i].count;
+	}
+	latency = malloc((total + 1) * sizeof(double));
+	seen = calloc(total + 1, 1);
+	if (latency == NULL || seen == NULL) {
+		printf("%s: out of memory\n", __FUNCTION__);
+		exit(EXIT_FAILURE);
+	}
+	sleep_sec = (pp->wait_ms + (pp->fixed_sleep || pp->wait_ms == 0 ? 0 : MS_SLEEP_EXTRA_MS)) / 1000.0;
+	pp->samples = 0;
+	pp->detected = 0;
+
+	while (t < model.duration) {
+		for (i = 0, base = 0; i < pp->nchan && t < model.duration; base += channels[i].count, i++) {
+			channel_t *pchan = &channels[i];
+
+			start_sec = cur_sec = (long)t;
+			while (cur_sec - start_sec < pp->check_sec) {
+				t_cmd = t + cmd_len[i] * model.byte_sec + model.reply_sec;
+				t = t_cmd + REPLY_LEN * model.byte_sec;
+				pp->samples++;
+
+				/* skip transmissions that ended before this sample */
+				while (first[i] < pchan->count &&
+				       pchan->xmit[first[i]].start + pchan->xmit[first[i]].len <= t_cmd) {
+					first[i]++;
+				}
+				for (j = first[i]; j < pchan->count && pchan->xmit[j].start <= t_cmd; j++) {
+					if (!seen[base + j] && t_cmd < pchan->xmit[j].start + pchan->xmit[j].len) {
+						seen[base + j] = 1;
+						latency[pp->detected++] = t - pchan->xmit[j].start;
+					}
+				}
+				cur_sec = (long)t;
+				t += sleep_sec;
+			}
+		}
+	}
+
+	pp->total = total;
+	pp->lat_avg = pp->lat_p95 = pp->lat_max = 0.0;
+	if (pp->detected > 0) {
+		qsort(latency, pp->detected, sizeof(double), compare_double);
+		for (i = 0; i < pp->detected; i++) {
+			sum += latency[i];
+		}
+		pp->lat_avg = sum / pp->detected;
+		pp->lat_p95 = latency[(pp->detected * 95) / 100 < pp->detected ?
+				      (pp->detected * 95) / 100 : pp->detected - 1];
+		pp->lat_max = latency[pp->detected - 1];
+	}
+	free(latency);
+	free(seen);
+}
+
+static void *worker(void *arg)
+{
+	int n;
+
+	while ((n = __atomic_fetch_add(&next_policy, 1, __ATOMIC_RELAXED)) < npolicies) {
+		simulate(&policies[n]);
+	}
+	return(NULL);
+}
+
+/* Parse a grid axis: 100  or  0,50,100  or  0:1000:50 */
+static int parse_grid(const char *arg, int *values, int min)
+{
+	int count = 0, lo, hi, step, v;
+	const char *p = arg;
+
+	if (sscanf(arg, "%d:%d:%d", &lo, &hi, &step) == 3 && step > 0) {
+		for (v = lo; v <= hi && count < MAX_GRID; v += step) {
+			values[count++] = v;
+		}
+	} else {
+		while (*p != '\0' && count < MAX_GRID) {
+			values[count++] = atoi(p);
+			p = strchr(p, ',');
+			if (p == NULL) {
+				break;
+			}
+			p++;
+		}
+	}
+	for (v = 0; v < count; v++) {
+		if (values[v] < min) {
+			printf("Grid value %d in %s less than %d\n", values[v], arg, min);
+			usage();  /* does not return */
+		}
+	}
+	return(count);
+}
+
+static int compare_policy(const void *a, const void *b)
+{
+	const policy_t *pa = a, *pb = b;
+	double ra = pa->total ? (double)pa->detected / pa->total : 0.0;
+	double rb = pb->total ? (double)pb->detected / pb->total : 0.0;
+
+	if (ra != rb) {
+		return(ra > rb ? -1 : 1);
+	}
+	return(compare_double(&pa->lat_avg, &pb->lat_avg));
+}
+
+int main(int argc, char *argv[])
+{
+	/* For command line parsing */
+	int next_option;
+	int option_index = 0; /* getopt_long stores the option index here. */
+
+	char *activity_file = NULL;
+	char *wait_arg = "100", *check_arg = "5", *chan_arg = NULL;
+	int wait_grid[MAX_GRID], check_grid[MAX_GRID], chan_grid[MAX_GRID];
+	int nwait, ncheck, nchan, nsleep = 1;
+	int synth_chan = 9, packet_ms = DEFAULT_PACKET_MS, merge_sec = DEFAULT_MERGE_SEC;
+	double rate_min = DEFAULT_RATE, hours = DEFAULT_HOURS;
+	int baud = DEFAULT_BAUD, reply_ms = DEFAULT_REPLY_MS;
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int seed = 1;
+	bool compare_sleep = false, sort_results = false;
+	pthread_t *threads;
+	struct timespec t0, t1;
+	double elapsed;
+	int i, a, b, c, d, transmissions = 0;
+
+	/* short options */
+	static const char *short_options = "hVda:n:r:l:T:R:g:w:s:c:b:m:j:xS";
+	/* long options */
+	static struct option long_options[] =
+	{
+		/* These options set a flag. */
+		{"verbose",     no_argument,  &gverbose_flag, true},
+		{"debug",       no_argument,  &DebugFlag, true},
+		/* These options don't set a flag.
+		We distinguish them by their indices. */
+		{"help",        no_argument,       NULL, 'h'},
+		{"activity",    required_argument, NULL, 'a'},
+		{"channels",    required_argument, NULL, 'n'},
+		{"rate",        required_argument, NULL, 'r'},
+		{"length",      required_argument, NULL, 'l'},
+		{"hours",       required_argument, NULL, 'T'},
+		{"seed",        required_argument, NULL, 'R'},
+		{"merge",       required_argument, NULL, 'g'},
+		{"wait",        required_argument, NULL, 'w'},
+		{"scan",        required_argument, NULL, 's'},
+		{"count",       required_argument, NULL, 'c'},
+		{"baud",        required_argument, NULL, 'b'},
+		{"reply",       required_argument, NULL, 'm'},
+		{"jobs",        required_argument, NULL, 'j'},
+		{"fixed-sleep", no_argument,       NULL, 'x'},
+		{"sort",        no_argument,       NULL, 'S'},
+		{NULL, no_argument, NULL, 0} /* array termination */
+	};
+
+	opterr = 0;
+	option_index = 0;
+	next_option = getopt_long (argc, argv, short_options,
+				   long_options, &option_index);
+
+	while( next_option != -1 ) {
+
+		switch (next_option) {
+			case 0:   /* long option without a short arg */
+				break;
+			case 'a': activity_file = optarg; break;
+			case 'n': synth_chan = atoi(optarg); break;
+			case 'r': rate_min = atof(optarg); break;
+			case 'l': packet_ms = atoi(optarg); break;
+			case 'T': hours = atof(optarg); break;
+			case 'R': seed = atoi(optarg); break;
+			case 'g': merge_sec = atoi(optarg); break;
+			case 'w': wait_arg = optarg; break;
+			case 's': check_arg = optarg; break;
+			case 'c': chan_arg = optarg; break;
+			case 'b': baud = atoi(optarg); break;
+			case 'm': reply_ms = atoi(optarg); break;
+			case 'j': nthreads = atoi(optarg); break;
+			case 'x': compare_sleep = true; break;
+			case 'S': sort_results = true; break;
+			case 'V':   /* set verbose flag */
+				gverbose_flag = true;
+				break;
+			case 'd':
+				DebugFlag = true;
+				break;
+			case 'h':
+				usage();  /* does not return */
+				break;
+			case '?':
+				if (isprint (optopt)) {
+					fprintf (stderr, "%s: Unknown option `-%c'.\n",
+						getprogname(), optopt);
+				} else {
+					fprintf (stderr,"%s: Unknown option character `\\x%x'.\n",
+						getprogname(), optopt);
+				}
+				/* fall through */
+			default:
+				usage();  /* does not return */
+				break;
+		}
+
+		next_option = getopt_long (argc, argv, short_options,
+					   long_options, &option_index);
+	}
+
+	model.byte_sec = 10.0 / baud;
+	model.reply_sec = reply_ms / 1000.0;
+	model.phase = 0.5;
+	if (activity_file != NULL) {
+		if (load_activity(activity_file, merge_sec) <= 0) {
+			printf("No activity in %s\n", activity_file);
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		model.duration = hours * 3600.0;
+		synth_traffic(synth_chan, rate_min, packet_ms, seed);
+	}
+	for (i = 0; i < nchannels; i++) {
+		transmissions += channels[i].count;
+		if (gverbose_flag) {
+			printf("  %s: %d transmissions\n", channels[i].freq, channels[i].count);
+		}
+	}
+
+	nwait = parse_grid(wait_arg, wait_grid, 0);
+	ncheck = parse_grid(check_arg, check_grid, 1);
+	if (chan_arg != NULL) {
+		nchan = parse_grid(chan_arg, chan_grid, 1);
+	} else {
+		chan_grid[0] = nchannels;
+		nchan = 1;
+	}
+	for (i = 0; i < nchan; i++) {
+		if (chan_grid[i] > nchannels) {
+			chan_grid[i] = nchannels;
+		}
+	}
+	if (compare_sleep) {
+		nsleep = 2;
+	}
+
+	npolicies = nwait * ncheck * nchan * nsleep;
+	policies = calloc(npolicies, sizeof(policy_t));
+	if (nthreads < 1) {
+		nthreads = 1;
+	}
+	threads = calloc(nthreads, sizeof(pthread_t));
+	if (policies == NULL || threads == NULL) {
+		exit(EXIT_FAILURE);
+	}
+	i = 0;
+	for (a = 0; a < nchan; a++) {
+		for (b = 0; b < ncheck; b++) {
+			for (c = 0; c < nwait; c++) {
+				for (d = 0; d < nsleep; d++) {
+					policies[i].nchan = chan_grid[a];
+					policies[i].check_sec = check_grid[b];
+					policies[i].wait_ms = wait_grid[c];
+					policies[i].fixed_sleep = d;
+					i++;
+				}
+			}
+		}
+	}
+
+	printf("Simulating %d policies on %d threads, %d channels, %d transmissions in %.1f min\n",
+	       npolicies, nthreads, nchannels, transmissions, model.duration / 60.0);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	if (sort_results) {
+		qsort(policies, npolicies, sizeof(policy_t), compare_policy);
+	}
+	printf("%5s %5s %4s %5s %8s %7s %8s %8s %8s\n",
+	       "chans", "check", "wait", "sleep", "detect%", "missed",
+	       "avg ms", "p95 ms", "max ms");
+	for (i = 0; i < npolicies; i++) {
+		policy_t *pp = &policies[i];
+
+		printf("%5d %5d %4d %5s %8.2f %7d %8.0f %8.0f %8.0f\n",
+		       pp->nchan, pp->check_sec, pp->wait_ms,
+		       pp->fixed_sleep ? "fixed" : "now",
+		       pp->total ? 100.0 * pp->detected / pp->total : 0.0,
+		       pp->total - pp->detected,
+		       pp->lat_avg * 1000.0, pp->lat_p95 * 1000.0, pp->lat_max * 1000.0);
+	}
+	printf("Ran %d policies in %.3f sec\n", npolicies, elapsed);
+
+	free(threads);
+	free(policies);
+	return(0);
+}
+
+const char *getprogname(void)
+{
+	return __progname;
+}
+
+/*
+ * Print usage information and exit
+ *  - does not return
+ */
+static void usage(void)
+{
+	printf("Usage:  %s [options]\n", getprogname());
+	printf("  Version: %s\n", PROG_VERSION);
+	printf("  Activity, synthetic Poisson traffic unless -a is given\n");
+	printf("  -a  --activity     ows_scan output or <freq> <start sec> <length ms> lines\n");
+	printf("  -g  --merge        ows_scan hits closer than this many sec are one packet (%d)\n", DEFAULT_MERGE_SEC);
+	printf("  -n  --channels     Synthetic channel count (9)\n");
+	printf("  -r  --rate         Synthetic packets per minute per channel (%.1f)\n", DEFAULT_RATE);
+	printf("  -l  --length       Synthetic packet length in ms (%d)\n", DEFAULT_PACKET_MS);
+	printf("  -T  --hours        Synthetic traffic hours (%.1f)\n", DEFAULT_HOURS);
+	printf("  -R  --seed         Synthetic traffic random seed (1)\n");
+	printf("  Policy grid, each a value, a list a,b,c or a range lo:hi:step\n");
+	printf("  -w  --wait         ows_scan -w wait ms (100)\n");
+	printf("  -s  --scan         ows_scan -s check sec (5)\n");
+	printf("  -c  --count        Scan the first N channels (all)\n");
+	printf("  -x  --fixed-sleep  Also run each policy without the extra ms_sleep second\n");
+	printf("  Timing model\n");
+	printf("  -b  --baud         Serial baud rate (%d)\n", DEFAULT_BAUD);
+	printf("  -m  --reply        Module turn around in ms (%d)\n", DEFAULT_REPLY_MS);
+	printf("  -j  --jobs         Worker threads (all cores)\n");
+	printf("  -S  --sort         Sort by detection then latency\n");
+	printf("  -V  --verbose      Print verbose messages\n");
+	printf("  -d  --debug        Turn on debug messages\n");
+	printf("  -h  --help         Display this usage info\n");
+
+	exit(EXIT_SUCCESS);
+}
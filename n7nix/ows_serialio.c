@@ -9,13 +9,405 @@
 #include <errno.h>
 #include <termios.h>
 #include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "ows_serialio.h"
+
+#define TRACE_MAGIC "OWST"
+#define TRACE_VERSION 1
+#define TRACE_DATA_MAX 128
+#define TRACE_DIR_TX 'T'
+#define TRACE_DIR_RX 'R'
 
 extern int DebugFlag;
 
+/* serial read timeout in msec */
+static int read_timeout = SERIAL_READ_TIMEOUT;
+
+/*
+ * Serial session trace
+ *  - every byte written to or read from the module is kept in a
+ *    fixed ring of records with a monotonic time stamp
+ *  - ring is written to the trace file on exit, on SIGINT/SIGTERM and
+ *    when SIGUSR1 is received
+ *
+ * Trace file format, host byte order:
+ *  header: "OWST", u8 version, 3 pad bytes, u32 record count
+ *  record: u32 usec since previous record, u8 direction ('T' or 'R'),
+ *          u8 length, length data bytes
+ */
+typedef struct trace_rec {
+	uint64_t ts_us;		/* monotonic time in usec */
+	uint8_t dir;
+	uint8_t len;
+	char data[TRACE_DATA_MAX];
+} trace_rec_t;
+
+static struct {
+	trace_rec_t *ring;
+	int nrecords;
+	unsigned long head;	/* total number of records recorded */
+	char pathname[256];
+	char tmpname[256];
+	volatile sig_atomic_t dump_request;
+} trace;
+
+static struct {
+	trace_rec_t *recs;
+	int nrecords;
+	bool realtime;
+	bool active;
+	pid_t pid;		/* replay child */
+} replay;
+
+static uint64_t trace_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+static void trace_record(uint8_t dir, const char *buf, int len)
+{
+	trace_rec_t *prec;
+	uint64_t now;
+	int reclen;
+
+	if (trace.ring == NULL) {
+		return;
+	}
+	now = trace_now_us();
+	/* Split anything longer than a record */
+	while (len > 0) {
+		reclen = len > TRACE_DATA_MAX ? TRACE_DATA_MAX : len;
+		prec = &trace.ring[trace.head % trace.nrecords];
+		prec->ts_us = now;
+		prec->dir = dir;
+		prec->len = reclen;
+		memcpy(prec->data, buf, reclen);
+		trace.head++;
+		buf += reclen;
+		len -= reclen;
+	}
+}
+
+/* Write all of buffer, only async signal safe calls */
+static int trace_write(int fd, const void *buf, size_t len)
+{
+	const char *pbuf = buf;
+	ssize_t iocnt;
+
+	while (len > 0) {
+		iocnt = write(fd, pbuf, len);
+		if (iocnt < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return(-1);
+		}
+		pbuf += iocnt;
+		len -= iocnt;
+	}
+	return(0);
+}
+
+/*
+ * Write trace ring to trace file, oldest record first
+ *  - only uses async signal safe calls so it can be run from a
+ *    signal handler
+ */
+int ows_trace_dump(void)
+{
+	unsigned long first, idx;
+	uint64_t prev_us;
+	uint32_t count, delta;
+	uint8_t hdr[8];
+	trace_rec_t *prec;
+	int fd;
+
+	if (trace.ring == NULL) {
+		return(-1);
+	}
+	trace.dump_request = 0;
+
+	fd = open(trace.tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return(-1);
+	}
+
+	first = trace.head > (unsigned long)trace.nrecords ?
+		trace.head - trace.nrecords : 0;
+	count = trace.head - first;
+
+	memcpy(hdr, TRACE_MAGIC, 4);
+	hdr[4] = TRACE_VERSION;
+	hdr[5] = hdr[6] = hdr[7] = 0;
+	if (trace_write(fd, hdr, sizeof(hdr)) < 0 ||
+	    trace_write(fd, &count, sizeof(count)) < 0) {
+		close(fd);
+		return(-1);
+	}
+
+	prev_us = count ? trace.ring[first % trace.nrecords].ts_us : 0;
+	for (idx = first; idx < trace.head; idx++) {
+		prec = &trace.ring[idx % trace.nrecords];
+		delta = prec->ts_us - prev_us;
+		prev_us = prec->ts_us;
+		if (trace_write(fd, &delta, sizeof(delta)) < 0 ||
+		    trace_write(fd, &prec->dir, 2) < 0 ||
+		    trace_write(fd, prec->data, prec->len) < 0) {
+			close(fd);
+			return(-1);
+		}
+	}
+	close(fd);
+
+	return(rename(trace.tmpname, trace.pathname));
+}
+
+static void trace_atexit(void)
+{
+	ows_trace_dump();
+}
+
+static void trace_sighandler(int sig)
+{
+	if (sig == SIGUSR1) {
+		/* dump on next serial write */
+		trace.dump_request = 1;
+		return;
+	}
+	ows_trace_dump();
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+/*
+ * Start recording the serial session in a ring of nrecords records
+ */
+int ows_trace_start(const char *pathname, int nrecords)
+{
+	if (nrecords <= 0) {
+		nrecords = TRACE_DEFAULT_RECORDS;
+	}
+	trace.ring = calloc(nrecords, sizeof(trace_rec_t));
+	if (trace.ring == NULL) {
+		printf("%s: Can not allocate %d trace records\n",
+		       __FUNCTION__, nrecords);
+		return(-1);
+	}
+	trace.nrecords = nrecords;
+	trace.head = 0;
+	snprintf(trace.pathname, sizeof(trace.pathname), "%s", pathname);
+	snprintf(trace.tmpname, sizeof(trace.tmpname), "%s.tmp", pathname);
+
+	atexit(trace_atexit);
+	signal(SIGINT, trace_sighandler);
+	signal(SIGTERM, trace_sighandler);
+	signal(SIGUSR1, trace_sighandler);
+
+	if(DebugFlag) {
+		printf("%s: recording %d records to %s\n",
+		       __FUNCTION__, nrecords, pathname);
+	}
+	return(0);
+}
+
+/*
+ * Load a trace file to be replayed by the next ows_initserial()
+ *  realtime: reproduce the recorded module response times,
+ *            otherwise answer as fast as possible
+ */
+int ows_replay_start(const char *pathname, bool realtime)
+{
+	FILE *fp;
+	char hdr[8];
+	uint32_t count, delta, i;
+	uint64_t ts_us = 0;
+	trace_rec_t *prec;
+
+	fp = fopen(pathname, "r");
+	if (fp == NULL) {
+		perror(pathname);
+		return(-1);
+	}
+	if (fread(hdr, sizeof(hdr), 1, fp) != 1 ||
+	    memcmp(hdr, TRACE_MAGIC, 4) != 0 || hdr[4] != TRACE_VERSION ||
+	    fread(&count, sizeof(count), 1, fp) != 1) {
+		printf("%s: %s is not a serial trace file\n",
+		       __FUNCTION__, pathname);
+		fclose(fp);
+		return(-1);
+	}
+
+	replay.recs = calloc(count ? count : 1, sizeof(trace_rec_t));
+	if (replay.recs == NULL) {
+		fclose(fp);
+		return(-1);
+	}
+	for (i = 0; i < count; i++) {
+		prec = &replay.recs[i];
+		if (fread(&delta, sizeof(delta), 1, fp) != 1 ||
+		    fread(&prec->dir, 2, 1, fp) != 1 ||
+		    prec->len > TRACE_DATA_MAX ||
+		    fread(prec->data, 1, prec->len, fp) != prec->len) {
+			printf("%s: %s truncated at record %u\n",
+			       __FUNCTION__, pathname, i);
+			break;
+		}
+		ts_us += delta;
+		prec->ts_us = ts_us;
+	}
+	fclose(fp);
+
+	replay.nrecords = i;
+	replay.realtime = realtime;
+	replay.active = true;
+
+	if(DebugFlag) {
+		printf("%s: loaded %d records from %s\n",
+		       __FUNCTION__, replay.nrecords, pathname);
+	}
+	return(0);
+}
+
+/* Length of a record without its line terminator, for printing */
+static int trace_linelen(const char *buf, int len)
+{
+	while (len > 0 && (buf[len-1] == '\r' || buf[len-1] == '\n')) {
+		len--;
+	}
+	return(len);
+}
+
+/*
+ * Replay child, plays the part of the module on one end of a socket pair
+ *  - waits for each recorded transmit record to be written by the host
+ *  - then sends the following receive records, with recorded timing
+ *    relative to the preceding transmit when realtime is set
+ */
+static void replay_feed(int sockfd)
+{
+	trace_rec_t *prec;
+	char txbuf[TRACE_DATA_MAX];
+	uint64_t anchor_now = trace_now_us(), anchor_ts = 0;
+	uint64_t due;
+	int i, iocnt, bufcnt, mismatch = 0;
+
+	if (replay.nrecords > 0) {
+		anchor_ts = replay.recs[0].ts_us;
+	}
+
+	for (i = 0; i < replay.nrecords; i++) {
+		prec = &replay.recs[i];
+
+		if (prec->dir == TRACE_DIR_TX) {
+			for (bufcnt = 0; bufcnt < prec->len; bufcnt += iocnt) {
+				iocnt = read(sockfd, &txbuf[bufcnt], prec->len - bufcnt);
+				if (iocnt <= 0) {
+					_exit(mismatch ? 1 : 0);
+				}
+			}
+			if (memcmp(txbuf, prec->data, prec->len) != 0) {
+				mismatch++;
+				fprintf(stderr, "replay: record %d: host sent %.*s expected %.*s\n",
+					i, trace_linelen(txbuf, prec->len), txbuf,
+					trace_linelen(prec->data, prec->len), prec->data);
+			}
+			anchor_now = trace_now_us();
+			anchor_ts = prec->ts_us;
+			continue;
+		}
+
+		if (replay.realtime) {
+			due = anchor_now + (prec->ts_us - anchor_ts);
+			while (trace_now_us() < due) {
+				uint64_t remain = due - trace_now_us();
+				struct timespec ts = { remain / 1000000, (remain % 1000000) * 1000 };
+				nanosleep(&ts, NULL);
+			}
+		}
+		if (trace_write(sockfd, prec->data, prec->len) < 0) {
+			_exit(mismatch ? 1 : 0);
+		}
+	}
+	if (mismatch) {
+		fprintf(stderr, "replay: %d transmit records differ from trace\n",
+			mismatch);
+	}
+	close(sockfd);
+	_exit(mismatch ? 1 : 0);
+}
+
+/*
+ * Set up a socket pair in place of the UART & fork the replay child
+ */
+static int replay_initserial(void)
+{
+	int sv[2];
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		perror("socketpair");
+		return(-1);
+	}
+	/* host writes after the trace ends should fail, not kill us */
+	signal(SIGPIPE, SIG_IGN);
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		close(sv[0]);
+		close(sv[1]);
+		return(-1);
+	}
+	if (pid == 0) {
+		close(sv[0]);
+		replay_feed(sv[1]);
+	}
+	close(sv[1]);
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	replay.pid = pid;
+
+	printf("Replaying %d trace records %s\n", replay.nrecords,
+	       replay.realtime ? "in real time" : "as fast as possible");
+	return(sv[0]);
+}
+
+/*
+ * Close the serial port, or end a replay
+ *  returns 0, -1 if the host did not send what the trace recorded
+ */
+int ows_closeserial(int fd)
+{
+	int status;
+
+	close(fd);
+	if (replay.pid <= 0) {
+		return(0);
+	}
+	/* replay child sees end of file & exits with the mismatch result */
+	if (waitpid(replay.pid, &status, 0) < 0) {
+		perror("waitpid");
+		return(-1);
+	}
+	replay.pid = 0;
+	return(WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1);
+}
+
 int ows_initserial(const char *pathname)
 {
 	int uart0fs;
 
+	if (replay.active) {
+		return(replay_initserial());
+	}
+
 	/* OPEN THE UART
 	 * The flags (defined in fcntl.h):
 	 *	Access modes (use 1 of these):
@@ -83,6 +475,10 @@ int ows_writeserbuf(int fs, char *outstring)
 	if (iocount < 0) {
 		printf("%s: UART TX error on buf: %s\n", __FUNCTION__, outbuf);
 	} else {
+		trace_record(TRACE_DIR_TX, outbuf, iocount);
+		if (trace.dump_request) {
+			ows_trace_dump();
+		}
 		if(DebugFlag) {
 			printf("%s: output(%d): %s", __FUNCTION__, iocount, outbuf);
 		}
@@ -104,10 +500,20 @@ int handle_serialread(int fs, char *rx_buffer, int len_rx_buffer)
 	} else {
 		/* byte(s) received */
 		rx_buffer[rx_length] = '\0';
+		trace_record(TRACE_DIR_RX, rx_buffer, rx_length);
 	}
 	return(rx_length);
 }
 
+/* Set read timeout in msec, returns previous timeout */
+int ows_setreadtimeout(int msec)
+{
+	int prev = read_timeout;
+
+	read_timeout = msec > 0 ? msec : SERIAL_READ_TIMEOUT;
+	return(prev);
+}
+
 int ows_readserbuf(int serialfs, char *readbuf, int len_readbuf)
 {
 	fd_set set;
@@ -118,8 +524,7 @@ int ows_readserbuf(int serialfs, char *readbuf, int len_readbuf)
 	memset(readbuf, 0, len_readbuf);
 
 	while(1) {
-		/* Set read timeout to 5 seconds */
-		struct timeval timeout={5,0};
+		struct timeval timeout={read_timeout / 1000, (read_timeout % 1000) * 1000};
 
 		FD_ZERO(&set);		/* clear the set */
 		FD_SET(serialfs, &set); /* add our file descriptor to the set */
@@ -138,9 +543,32 @@ int ows_readserbuf(int serialfs, char *readbuf, int len_readbuf)
 			break;
 		} else {
 			/* there was data to read, so read it */
-			iocnt = handle_serialread( serialfs, &readbuf[bufcnt], len_readbuf-bufcnt );
+			if (bufcnt >= len_readbuf - 1) {
+				/* buffer full without a line terminator */
+				printf("%s: garbled response(%d): %s\n",
+				       __FUNCTION__, bufcnt, readbuf);
+				retcode = bufcnt;
+				break;
+			}
+			/* leave room for string terminator */
+			iocnt = handle_serialread( serialfs, &readbuf[bufcnt], len_readbuf-bufcnt-1 );
+			if (iocnt == 0) {
+				/* end of file, replay finished or device gone */
+				retcode = -1;
+				break;
+			}
+			if (iocnt < 0) {
+				if (errno == EINTR || errno == EAGAIN) {
+					continue;
+				}
+				/* eg. EIO after a USB serial adapter is unplugged */
+				perror("read");
+				retcode = -1;
+				break;
+			}
 			bufcnt+=iocnt;
-			if (readbuf[bufcnt-2] == 0x0d && readbuf[bufcnt-1] == 0x0a) {
+			if (bufcnt >= 2 &&
+			    readbuf[bufcnt-2] == 0x0d && readbuf[bufcnt-1] == 0x0a) {
 				if(DebugFlag) {
 					printf("%s: Response(%d): %s", __FUNCTION__, bufcnt, readbuf);
 				}
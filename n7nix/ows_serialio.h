@@ -0,0 +1,25 @@
+/*
+ * Fundamental serial io routines for Dorji DRA818V module
+ */
+#ifndef OWS_SERIALIO_H
+#define OWS_SERIALIO_H
+
+#include <stdbool.h>
+
+/* Default serial read timeout in msec */
+#define SERIAL_READ_TIMEOUT 5000
+/* Number of records kept in the serial trace ring */
+#define TRACE_DEFAULT_RECORDS 1024
+
+int ows_initserial(const char *pathname);
+int ows_writeserbuf(int fs, char *outstring);
+int ows_readserbuf(int serialfs, char *readbuf, int len_readbuf);
+int ows_setreadtimeout(int msec);
+
+/* Serial session recorder & replay */
+int ows_trace_start(const char *pathname, int nrecords);
+int ows_trace_dump(void);
+int ows_replay_start(const char *pathname, bool realtime);
+int ows_closeserial(int fd);
+
+#endif /* OWS_SERIALIO_H */
@@ -0,0 +1,445 @@
+/*
+ * Per channel squelch tuning
+ *  - sweeps squelch 0-8 on each channel, levels interleaved in short
+ *    slices so every level sees the same traffic
+ *  - squelch openings shorter than the shortest real transmission
+ *    are false triggers
+ *  - picks the lowest level, most sensitive, with a false trigger
+ *    rate under target & saves it for ows_scan -q
+ *  - reports false HIT events & time busy on noise against the global
+ *    squelch set by ows_init, with the AT+DMOSETGROUP time ows_scan -q
+ *    adds when the level changes on a retune
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <time.h>
+#include <signal.h>
+
+#include "ows_serialio.h"
+#include "ows_module.h"
+#include "ows_plan.h"
+#include "ows_squelch.h"
+
+#define PROG_VERSION "1.0"
+/* Links to: /dev/ttyAMA0 on RPi 2, /dev/ttyS0 on RPi 3 */
+#define RPI_SERIAL_DEVICE "/dev/serial0"
+#define SIZE_READBUF 128
+#define SIZE_ATBUF 128
+
+#define DEFAULT_LEVEL_SEC 30	/* listening time per squelch level per channel */
+#define DEFAULT_SLICE_MS 1000	/* listening time per level visit */
+#define DEFAULT_MIN_MS 300	/* shorter openings are false triggers */
+#define DEFAULT_TARGET 1.0	/* false triggers per minute */
+#define SLICE_EXTEND_MS 5000	/* keep listening past a slice while squelch is open */
+#define MAX_CHANS 15		/* MAX_FREQ_COUNT in ows_scan */
+#define DEFAULT_SCAN_SEC 5	/* ows_scan -s dwell per channel */
+
+static void usage(void);
+const char *getprogname(void);
+
+int DebugFlag = false;
+int gverbose_flag = false;
+
+static volatile sig_atomic_t tune_done;
+
+static void tune_sighandler(int sig)
+{
+	tune_done = 1;
+}
+
+extern char *__progname;
+
+typedef struct level_stats {
+	double listen_ms;
+	unsigned long false_trips;
+	double false_ms;	/* squelch open on noise */
+	unsigned long real;
+	double real_ms;
+} level_stats_t;
+
+typedef struct chan {
+	double mhz;
+	int sq;			/* picked level */
+	level_stats_t level[OWS_SQUELCH_LEVELS];
+} chan_t;
+
+static int min_ms = DEFAULT_MIN_MS;
+static double setgroup_ms;	/* AT+DMOSETGROUP round trips, total */
+static unsigned long setgroups;
+
+/* One S+ sample, returns 1 busy, 0 quiet, -1 no reply */
+static int sample(int fd, const char *atbuf)
+{
+	char readbuf[SIZE_READBUF];
+	int retcode;
+
+	retcode = ows_module_command(fd, (char *)atbuf, readbuf, sizeof(readbuf));
+	if (retcode <= 0) {
+		return(-1);
+	}
+	return(atoi(&readbuf[2]) != 1);
+}
+
+static void count_opening(level_stats_t *pl, double open_ms)
+{
+	if (open_ms < min_ms) {
+		pl->false_trips++;
+		pl->false_ms += open_ms;
+	} else {
+		pl->real++;
+		pl->real_ms += open_ms;
+	}
+}
+
+/*
+ * Listen at one squelch level for slice_ms
+ *  - an opening still going at the end of the slice is followed
+ *    to its end so it is not cut short into a false trigger
+ *  returns -1 if the module stopped answering
+ */
+static int listen_slice(int fd, const char *atbuf, int slice_ms, level_stats_t *pl)
+{
+	double t_start, t_end, t, t_open = -1.0;
+	int busy, misses = 0;
+
+	t_start = ows_module_now_ms();
+	t_end = t_start + slice_ms;
+	for (t = t_start; !tune_done; ) {
+		if (t >= t_end && (t_open < 0.0 || t >= t_end + SLICE_EXTEND_MS)) {
+			break;
+		}
+		busy = sample(fd, atbuf);
+		t = ows_module_now_ms();
+		if (busy < 0) {
+			if (++misses > 3) {
+				return(-1);
+			}
+			continue;
+		}
+		misses = 0;
+		if (busy && t_open < 0.0) {
+			t_open = t;
+		} else if (!busy && t_open >= 0.0) {
+			count_opening(pl, t - t_open);
+			t_open = -1.0;
+		}
+	}
+	if (t_open >= 0.0) {
+		count_opening(pl, t - t_open);
+	}
+	pl->listen_ms += t - t_start;
+	return(0);
+}
+
+static double per_min(unsigned long count, double ms)
+{
+	return(ms > 0.0 ? count * 60000.0 / ms : 0.0);
+}
+
+static double pct(double part, double whole)
+{
+	return(whole > 0.0 ? 100.0 * part / whole : 0.0);
+}
+
+/* Lowest level under the false trigger target, else the quietest */
+static int pick_level(chan_t *pc, double target)
+{
+	double rate, best_rate = 0.0;
+	int sq, best = OWS_SQUELCH_LEVELS - 1;
+
+	for (sq = 0; sq < OWS_SQUELCH_LEVELS; sq++) {
+		rate = per_min(pc->level[sq].false_trips, pc->level[sq].listen_ms);
+		if (rate <= target) {
+			return(sq);
+		}
+		if (sq == 0 || rate < best_rate) {
+			best_rate = rate;
+			best = sq;
+		}
+	}
+	return(best);
+}
+
+static void chan_report(chan_t *pc, int global_sq)
+{
+	level_stats_t *pl;
+	int sq;
+
+	printf("%.4f MHz\n", pc->mhz);
+	printf("  sq  false/min  noise  real/min  listen\n");
+	for (sq = 0; sq < OWS_SQUELCH_LEVELS; sq++) {
+		pl = &pc->level[sq];
+		printf("  %2d  %9.1f  %4.1f%%  %8.1f  %5.1f sec%s\n", sq,
+		       per_min(pl->false_trips, pl->listen_ms),
+		       pct(pl->false_ms, pl->listen_ms),
+		       per_min(pl->real, pl->listen_ms),
+		       pl->listen_ms / 1000.0,
+		       sq == pc->sq ? "  <- picked" : sq == global_sq ? "  <- global" : "");
+	}
+}
+
+/*
+ * What ows_scan -q changes, global squelch against tuned, per hour of
+ * scanning with each channel an equal share of it
+ *  - ows_scan dwells scan_sec on a channel whatever it hears, so noise
+ *    costs no scan time: it costs false HIT events & time subscribers
+ *    see a channel busy on noise
+ *  - a retune to a channel with another level adds an AT+DMOSETGROUP
+ *    round trip, in list order, ows_scan -P may order them otherwise.
+ *    That is scan time, reported apart from time busy on noise
+ */
+static void summary(chan_t *chans, int nchans, int global_sq, int scan_sec)
+{
+	level_stats_t *pg, *pt;
+	double noise_g = 0.0, noise_t = 0.0, false_g = 0.0, false_t = 0.0;
+	double real_g = 0.0, real_t = 0.0, group_ms, group_sec;
+	int changes = 0, i;
+
+	for (i = 0; i < nchans; i++) {
+		pg = &chans[i].level[global_sq];
+		pt = &chans[i].level[chans[i].sq];
+		noise_g += pct(pg->false_ms, pg->listen_ms) * 36.0 / nchans;
+		noise_t += pct(pt->false_ms, pt->listen_ms) * 36.0 / nchans;
+		false_g += per_min(pg->false_trips, pg->listen_ms) * 60.0 / nchans;
+		false_t += per_min(pt->false_trips, pt->listen_ms) * 60.0 / nchans;
+		real_g += per_min(pg->real, pg->listen_ms) * 60.0 / nchans;
+		real_t += per_min(pt->real, pt->listen_ms) * 60.0 / nchans;
+		if (nchans > 1 && chans[i].sq != chans[(i + nchans - 1) % nchans].sq) {
+			changes++;
+		}
+	}
+	group_ms = setgroups > 0 ? setgroup_ms / setgroups : 0.0;
+	/* one cycle is nchans dwells */
+	group_sec = changes * group_ms / 1000.0 * 3600.0 / ((double)nchans * scan_sec);
+
+	printf("Squelch global %d against tuned, per hour of ows_scan -s %d:\n",
+	       global_sq, scan_sec);
+	printf("  false HIT events: %.0f -> %.0f\n", false_g, false_t);
+	printf("  busy on noise: %.1f sec -> %.1f sec\n", noise_g, noise_t);
+	printf("  AT+DMOSETGROUP: %d of %d retunes change level, %.1f ms each, %.1f sec of scan time\n",
+	       changes, nchans, group_ms, group_sec);
+	printf("  real transmissions heard: %.0f -> %.0f\n", real_g, real_t);
+}
+
+int main(int argc, char *argv[])
+{
+	/* For command line parsing */
+	int next_option;
+	int option_index = 0; /* getopt_long stores the option index here. */
+
+	int uart0fs;
+	char atbuf[SIZE_ATBUF];
+	char *serial_device = RPI_SERIAL_DEVICE;
+	char *conf_file = OWS_SQUELCH_CONF, *model_file = OWS_PLAN_MODEL;
+	int level_sec = DEFAULT_LEVEL_SEC, slice_ms = DEFAULT_SLICE_MS;
+	int scan_sec = DEFAULT_SCAN_SEC;
+	double target = DEFAULT_TARGET, prev_mhz = 0.0, skip_ms, t_set;
+	bool save = true;
+	chan_t chans[MAX_CHANS];
+	ows_squelch_chan_t tuned[OWS_SQUELCH_CHANS];
+	ows_plan_model_t model;
+	int nchans = 0, ntuned, global_sq, rounds, r, sq, i;
+
+	/* short options */
+	static const char *short_options = "hVdD:T:l:p:F:s:o:nM:";
+	/* long options */
+	static struct option long_options[] =
+	{
+		/* These options set a flag. */
+		{"verbose",     no_argument,  &gverbose_flag, true},
+		{"debug",       no_argument,  &DebugFlag, true},
+		/* These options don't set a flag.
+		We distinguish them by their indices. */
+		{"help",        no_argument,       NULL, 'h'},
+		{"device",      required_argument, NULL, 'D'},
+		{"time",        required_argument, NULL, 'T'},
+		{"slice",       required_argument, NULL, 'l'},
+		{"packet",      required_argument, NULL, 'p'},
+		{"false",       required_argument, NULL, 'F'},
+		{"scan",        required_argument, NULL, 's'},
+		{"output",      required_argument, NULL, 'o'},
+		{"dry-run",     no_argument,       NULL, 'n'},
+		{"model",       required_argument, NULL, 'M'},
+		{NULL, no_argument, NULL, 0} /* array termination */
+	};
+
+	opterr = 0;
+	option_index = 0;
+	next_option = getopt_long (argc, argv, short_options,
+				   long_options, &option_index);
+
+	while( next_option != -1 ) {
+
+		switch (next_option) {
+			case 0:   /* long option without a short arg */
+				break;
+			case 'D': serial_device = optarg; break;
+			case 'T': level_sec = atoi(optarg); break;
+			case 'l': slice_ms = atoi(optarg); break;
+			case 'p': min_ms = atoi(optarg); break;
+			case 'F': target = atof(optarg); break;
+			case 's': scan_sec = atoi(optarg); break;
+			case 'o': conf_file = optarg; break;
+			case 'n': save = false; break;
+			case 'M': model_file = optarg; break;
+			case 'V':   /* set verbose flag */
+				gverbose_flag = true;
+				break;
+			case 'd':
+				DebugFlag = true;
+				break;
+			case 'h':
+				usage();  /* does not return */
+				break;
+			case '?':
+				if (isprint (optopt)) {
+					fprintf (stderr, "%s: Unknown option `-%c'.\n",
+						getprogname(), optopt);
+				} else {
+					fprintf (stderr,"%s: Unknown option character `\\x%x'.\n",
+						getprogname(), optopt);
+				}
+				/* fall through */
+			default:
+				usage();  /* does not return */
+				break;
+		}
+
+		next_option = getopt_long (argc, argv, short_options,
+					   long_options, &option_index);
+	}
+
+	memset(chans, 0, sizeof(chans));
+	while (optind < argc) {
+		if (nchans == MAX_CHANS) {
+			printf("Too many frequencies at %s, %d max\n", argv[optind], MAX_CHANS);
+			exit(EXIT_FAILURE);
+		}
+		if (parse_mhz(argv[optind], &chans[nchans].mhz) < 0) {
+			printf("Parse error for frequency: %s\n", argv[optind]);
+			usage();  /* does not return */
+		}
+		nchans++;
+		optind++;
+	}
+	if (nchans == 0 || level_sec <= 0 || slice_ms <= 0 || scan_sec <= 0) {
+		usage();  /* does not return */
+	}
+
+	if (ows_state_load(OWS_STATE_FILE) <= 0 ||
+	    (global_sq = ows_squelch_cached()) < 0) {
+		printf("No cached configuration in %s, run ows_init first\n", OWS_STATE_FILE);
+		exit(EXIT_FAILURE);
+	}
+	/* S+ replies chatter while the synthesizer settles */
+	if (ows_plan_load_model(model_file, &model) < 0) {
+		memset(&model, 0, sizeof(model));
+	}
+
+	uart0fs = ows_initserial(serial_device);
+	if (uart0fs == -1) {
+		exit(EXIT_FAILURE);
+	}
+	signal(SIGINT, tune_sighandler);
+	signal(SIGTERM, tune_sighandler);
+
+	rounds = (level_sec * 1000 + slice_ms - 1) / slice_ms;
+	printf("Tuning squelch on %d channels, %d sec per level, %.1f min per channel, global squelch %d\n",
+	       nchans, level_sec, rounds * slice_ms * OWS_SQUELCH_LEVELS / 60000.0, global_sq);
+	fflush(stdout);
+
+	for (i = 0; i < nchans && !tune_done; i++) {
+		snprintf(atbuf, sizeof(atbuf), "S+%.4f", chans[i].mhz);
+		skip_ms = prev_mhz != 0.0 ? ows_plan_retune_ms(&model, prev_mhz, chans[i].mhz) : 0.0;
+		prev_mhz = chans[i].mhz;
+		if (skip_ms > 0.0) {
+			sample(uart0fs, atbuf);
+			ows_module_sleep_ms((int)skip_ms);
+		}
+		for (r = 0; r < rounds && !tune_done; r++) {
+			for (sq = 0; sq < OWS_SQUELCH_LEVELS && !tune_done; sq++) {
+				/* alternate direction so no level always follows another */
+				int level = (r & 1) ? OWS_SQUELCH_LEVELS - 1 - sq : sq;
+
+				t_set = ows_module_now_ms();
+				if (ows_squelch_set(uart0fs, level) < 0) {
+					printf("Module not answering, stopping\n");
+					tune_done = 1;
+					break;
+				}
+				/* what ows_scan -q pays on a retune that changes level */
+				setgroup_ms += ows_module_now_ms() - t_set;
+				setgroups++;
+				if (listen_slice(uart0fs, atbuf, slice_ms, &chans[i].level[level]) < 0) {
+					printf("Module not answering, stopping\n");
+					tune_done = 1;
+				}
+			}
+		}
+		chans[i].sq = pick_level(&chans[i], target);
+		chan_report(&chans[i], global_sq);
+		fflush(stdout);
+	}
+	/* back to the configuration ows_init set */
+	ows_squelch_set(uart0fs, global_sq);
+	close(uart0fs);
+
+	if (tune_done) {
+		printf("Sweep not finished, nothing saved\n");
+		exit(EXIT_FAILURE);
+	}
+	summary(chans, nchans, global_sq, scan_sec);
+
+	if (save) {
+		ntuned = ows_squelch_load(conf_file, tuned, OWS_SQUELCH_CHANS);
+		if (ntuned < 0) {
+			ntuned = 0;
+		}
+		for (i = 0; i < nchans; i++) {
+			ntuned = ows_squelch_update(tuned, ntuned, OWS_SQUELCH_CHANS,
+						    chans[i].mhz, chans[i].sq);
+		}
+		if (ows_squelch_save(conf_file, tuned, ntuned) < 0) {
+			exit(EXIT_FAILURE);
+		}
+		printf("Saved to %s, scan with ows_scan -q\n", conf_file);
+	}
+
+	exit(EXIT_SUCCESS);
+}
+
+const char *getprogname(void)
+{
+	return __progname;
+}
+
+/*
+ * Print usage information and exit
+ *  - does not return
+ */
+static void usage(void)
+{
+	printf("Usage:  %s [options] freq freq ...\n", getprogname());
+	printf("  Version: %s\n", PROG_VERSION);
+	printf("  Picks a squelch level per channel, run ows_init first\n");
+	printf("  -T  --time      Listening time per squelch level per channel in sec (%d)\n", DEFAULT_LEVEL_SEC);
+	printf("  -l  --slice     Listening time per level visit in msec (%d)\n", DEFAULT_SLICE_MS);
+	printf("  -p  --packet    Shortest real transmission in msec (%d)\n", DEFAULT_MIN_MS);
+	printf("  -F  --false     Target false triggers per minute (%.1f)\n", DEFAULT_TARGET);
+	printf("  -s  --scan      ows_scan -s dwell per channel in sec, for the report (%d)\n", DEFAULT_SCAN_SEC);
+	printf("  -o  --output    Squelch file (%s)\n", OWS_SQUELCH_CONF);
+	printf("  -n  --dry-run   Report only, do not save\n");
+	printf("  -M  --model     Retune model, to skip settling after a retune (%s)\n", OWS_PLAN_MODEL);
+	printf("  -D  --device    Serial device (%s)\n", RPI_SERIAL_DEVICE);
+	printf("  -V  --verbose   Print verbose messages\n");
+	printf("  -d  --debug     Turn on debug messages\n");
+	printf("  -h  --help      Display this usage info\n");
+
+	exit(EXIT_SUCCESS);
+}
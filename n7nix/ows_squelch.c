@@ -0,0 +1,156 @@
+/*
+ * Per channel squelch levels
+ *
+ * The DRA818V has one squelch level, set with the rest of the group
+ * in AT+DMOSETGROUP. A channel's level is applied by resending the
+ * AT+DMOSETGROUP cached by ows_init with only the SQ field changed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+
+#include "ows_module.h"
+#include "ows_squelch.h"
+
+#define SIZE_READBUF 128
+#define SIZE_ATBUF 128
+#define GROUP_SQ_FIELD 4	/* GBW,TFV,RFV,Tx_CTCSS,SQ,Rx_CTCSS */
+
+extern int DebugFlag;
+
+/* "<MHz> <squelch>" per line, returns channel count, -1 no file */
+int ows_squelch_load(const char *pathname, ows_squelch_chan_t *chans, int max)
+{
+	FILE *fp;
+	char line[128];
+	int count = 0;
+
+	fp = fopen(pathname, "r");
+	if (fp == NULL) {
+		return(-1);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL && count < max) {
+		if (line[0] == '#') {
+			continue;
+		}
+		if (sscanf(line, "%lf %d", &chans[count].mhz, &chans[count].sq) == 2 &&
+		    chans[count].sq >= 0 && chans[count].sq < OWS_SQUELCH_LEVELS) {
+			count++;
+		}
+	}
+	fclose(fp);
+	return(count);
+}
+
+int ows_squelch_save(const char *pathname, ows_squelch_chan_t *chans, int count)
+{
+	FILE *fp;
+	int i;
+
+	fp = fopen(pathname, "w");
+	if (fp == NULL) {
+		perror(pathname);
+		return(-1);
+	}
+	fprintf(fp, "# ows_sqtune per channel squelch, <MHz> <level 0-8>\n");
+	for (i = 0; i < count; i++) {
+		fprintf(fp, "%.4f %d\n", chans[i].mhz, chans[i].sq);
+	}
+	fclose(fp);
+	return(0);
+}
+
+/* Squelch for a channel, -1 if not tuned */
+int ows_squelch_lookup(ows_squelch_chan_t *chans, int count, double mhz)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (fabs(chans[i].mhz - mhz) < 0.00005) {
+			return(chans[i].sq);
+		}
+	}
+	return(-1);
+}
+
+/* Replace or add a channel, returns new count */
+int ows_squelch_update(ows_squelch_chan_t *chans, int count, int max, double mhz, int sq)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (fabs(chans[i].mhz - mhz) < 0.00005) {
+			chans[i].sq = sq;
+			return(count);
+		}
+	}
+	if (count == max) {
+		printf("%s: more than %d channels, dropping %.4f\n", __FUNCTION__, max, mhz);
+		return(count);
+	}
+	chans[count].mhz = mhz;
+	chans[count].sq = sq;
+	return(count + 1);
+}
+
+/* Start of the SQ field in the cached group command, NULL if none */
+static const char *group_sq(const char **pgroup)
+{
+	const char *p;
+	int i;
+
+	*pgroup = ows_state_get("AT+DMOSETGROUP");
+	if (*pgroup == NULL) {
+		return(NULL);
+	}
+	p = *pgroup;
+	for (i = 0; i < GROUP_SQ_FIELD && p != NULL; i++) {
+		p = strchr(p, ',');
+		if (p != NULL) {
+			p++;
+		}
+	}
+	return(p);
+}
+
+/* Squelch of the cached configuration, -1 if ows_init has not run */
+int ows_squelch_cached(void)
+{
+	const char *group, *p;
+
+	p = group_sq(&group);
+	return(p == NULL ? -1 : atoi(p));
+}
+
+/*
+ * Set module squelch level
+ *  - the new group command is cached so a watchdog power cycle
+ *    comes back with the same level
+ *  returns 0, -1 no cached configuration or no reply
+ */
+int ows_squelch_set(int fd, int sq)
+{
+	char atbuf[SIZE_ATBUF], readbuf[SIZE_READBUF];
+	const char *group, *p;
+
+	p = group_sq(&group);
+	if (p == NULL) {
+		return(-1);
+	}
+	snprintf(atbuf, sizeof(atbuf), "%.*s%d%s",
+		 (int)(p - group), group, sq, p + strcspn(p, ","));
+
+	if (ows_module_command(fd, atbuf, readbuf, sizeof(readbuf)) <= 0 ||
+	    strstr(readbuf, "+DMOSETGROUP:0") == NULL) {
+		printf("%s: no reply to %s\n", __FUNCTION__, atbuf);
+		return(-1);
+	}
+	if(DebugFlag) {
+		printf("%s: %s\n", __FUNCTION__, atbuf);
+	}
+	ows_state_cache(atbuf);
+	return(0);
+}
@@ -0,0 +1,26 @@
+/*
+ * Per channel squelch levels
+ */
+#ifndef OWS_SQUELCH_H
+#define OWS_SQUELCH_H
+
+/* Written by ows_sqtune, one per site */
+#define OWS_SQUELCH_CONF "/usr/local/etc/ows_squelch.conf"
+#define OWS_SQUELCH_LEVELS 9	/* DRA818V squelch 0-8 */
+#define OWS_SQUELCH_CHANS 32
+
+typedef struct ows_squelch_chan {
+	double mhz;
+	int sq;
+} ows_squelch_chan_t;
+
+int ows_squelch_load(const char *pathname, ows_squelch_chan_t *chans, int max);
+int ows_squelch_save(const char *pathname, ows_squelch_chan_t *chans, int count);
+int ows_squelch_lookup(ows_squelch_chan_t *chans, int count, double mhz);
+int ows_squelch_update(ows_squelch_chan_t *chans, int count, int max, double mhz, int sq);
+
+/* Module squelch, from the AT+DMOSETGROUP cached by ows_init */
+int ows_squelch_cached(void);
+int ows_squelch_set(int fd, int sq);
+
+#endif /* OWS_SQUELCH_H */
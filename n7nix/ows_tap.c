@@ -0,0 +1,385 @@
+/*
+ * Shared audio tap, one capture of the UDRC read in place by many
+ * consumers
+ *
+ * The broker writes interleaved 16 bit frames into a shared memory
+ * ring of OWS_TAP_FRAMES. The ring is mapped twice, back to back, so
+ * any span of it is contiguous: the broker captures straight into the
+ * ring & consumers get a pointer into it, no copies.
+ *
+ * Every OWS_TAP_PERIOD frames get a CLOCK_MONOTONIC time stamp.
+ * Each consumer owns a slot in the header with its read position,
+ * lag & overrun counters, so the broker can report on all of them.
+ * The writer never waits: a consumer that falls a ring behind skips
+ * to the newest audio & counts an overrun.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "ows_tap.h"
+
+#define TAP_MAGIC 0x4f575354	/* OWST */
+#define TAP_VERSION 1
+#define TAP_MASK (OWS_TAP_FRAMES - 1)
+#define TAP_NSTAMPS (OWS_TAP_FRAMES / OWS_TAP_PERIOD)
+#define TAP_FRAME_BYTES (OWS_TAP_CHANNELS * sizeof(int16_t))
+#define TAP_DATA_BYTES (OWS_TAP_FRAMES * TAP_FRAME_BYTES)
+
+extern int DebugFlag;
+
+typedef struct tap_consumer {
+	int32_t pid;		/* 0 free */
+	uint32_t pad;
+	uint64_t pos;		/* next frame to read */
+	uint64_t lag_max;
+	uint64_t overruns;
+	uint64_t lost;
+	char name[OWS_TAP_NAME_LEN];
+} tap_consumer_t;
+
+typedef struct tap_stamp {
+	uint64_t frame;		/* first frame of the period */
+	int64_t mono_ns;
+} tap_stamp_t;
+
+typedef struct tap_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t rate;
+	uint32_t channels;
+	uint32_t frames;
+	uint32_t period;
+	uint32_t futex;		/* bumped on every commit */
+	uint32_t waiters;	/* consumers sleeping on futex */
+	uint64_t head;		/* frames written since the ring was created */
+	int32_t writer_pid;
+	uint32_t pad;
+	tap_consumer_t consumer[OWS_TAP_MAX_CONSUMERS];
+	tap_stamp_t stamp[TAP_NSTAMPS];
+} tap_hdr_t;
+
+struct ows_tap {
+	tap_hdr_t *hdr;
+	size_t hdr_size;
+	uint8_t *data;		/* TAP_DATA_BYTES mapped twice */
+	tap_consumer_t *me;	/* consumer slot, NULL for the broker */
+	uint64_t held;		/* frames handed out by ows_tap_read */
+};
+
+static int futex(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout)
+{
+	return(syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0));
+}
+
+/* Map header & the ring twice, data is read only for consumers */
+static ows_tap_t *tap_map(int create)
+{
+	ows_tap_t *tap;
+	long page = sysconf(_SC_PAGESIZE);
+	int prot = create ? PROT_READ | PROT_WRITE : PROT_READ;
+	uint8_t *base;
+	int fd;
+
+	tap = calloc(1, sizeof(ows_tap_t));
+	if (tap == NULL) {
+		return(NULL);
+	}
+	tap->hdr_size = (sizeof(tap_hdr_t) + page - 1) / page * page;
+
+	fd = shm_open(OWS_TAP_SHM, create ? O_RDWR | O_CREAT : O_RDWR, 0660);
+	if (fd < 0) {
+		perror("shm_open " OWS_TAP_SHM);
+		free(tap);
+		return(NULL);
+	}
+	/* consumers write their slot, open to the broker's group past the umask */
+	if (create && fchmod(fd, 0660) < 0) {
+		perror("fchmod " OWS_TAP_SHM);
+		goto fail;
+	}
+	if (create && ftruncate(fd, tap->hdr_size + TAP_DATA_BYTES) < 0) {
+		perror("ftruncate");
+		goto fail;
+	}
+	tap->hdr = mmap(NULL, tap->hdr_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (tap->hdr == MAP_FAILED) {
+		perror("mmap");
+		goto fail;
+	}
+	/* reserve twice the ring, then map the same pages into both halves */
+	base = mmap(NULL, 2 * TAP_DATA_BYTES, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED ||
+	    mmap(base, TAP_DATA_BYTES, prot, MAP_SHARED | MAP_FIXED,
+		 fd, tap->hdr_size) == MAP_FAILED ||
+	    mmap(base + TAP_DATA_BYTES, TAP_DATA_BYTES, prot, MAP_SHARED | MAP_FIXED,
+		 fd, tap->hdr_size) == MAP_FAILED) {
+		perror("mmap ring");
+		munmap(tap->hdr, tap->hdr_size);
+		goto fail;
+	}
+	tap->data = base;
+	close(fd);
+	return(tap);
+
+fail:
+	close(fd);
+	free(tap);
+	return(NULL);
+}
+
+/*
+ * Create or reuse the ring, consumers of a previous broker stay attached
+ */
+ows_tap_t *ows_tap_create(int rate)
+{
+	ows_tap_t *tap;
+	tap_hdr_t *hdr;
+
+	tap = tap_map(1);
+	if (tap == NULL) {
+		return(NULL);
+	}
+	hdr = tap->hdr;
+	if (hdr->magic != TAP_MAGIC || hdr->version != TAP_VERSION ||
+	    hdr->frames != OWS_TAP_FRAMES || hdr->period != OWS_TAP_PERIOD ||
+	    hdr->channels != OWS_TAP_CHANNELS) {
+		memset(hdr, 0, sizeof(tap_hdr_t));
+		hdr->version = TAP_VERSION;
+		hdr->channels = OWS_TAP_CHANNELS;
+		hdr->frames = OWS_TAP_FRAMES;
+		hdr->period = OWS_TAP_PERIOD;
+		__atomic_store_n(&hdr->magic, TAP_MAGIC, __ATOMIC_RELEASE);
+	}
+	hdr->rate = rate;
+	hdr->writer_pid = getpid();
+	return(tap);
+}
+
+/* Room for OWS_TAP_PERIOD frames at the head of the ring */
+int16_t *ows_tap_write_ptr(ows_tap_t *tap)
+{
+	return((int16_t *)(tap->data + (tap->hdr->head & TAP_MASK) * TAP_FRAME_BYTES));
+}
+
+/*
+ * Publish nframes, at most OWS_TAP_PERIOD, written at ows_tap_write_ptr
+ *  mono_ns is the capture time of the first frame
+ */
+void ows_tap_commit(ows_tap_t *tap, int nframes, int64_t mono_ns)
+{
+	tap_hdr_t *hdr = tap->hdr;
+	uint64_t head = hdr->head;
+	tap_stamp_t *ps = &hdr->stamp[(head / OWS_TAP_PERIOD) % TAP_NSTAMPS];
+
+	ps->frame = head;
+	ps->mono_ns = mono_ns;
+	__atomic_store_n(&hdr->head, head + nframes, __ATOMIC_RELEASE);
+
+	__atomic_fetch_add(&hdr->futex, 1, __ATOMIC_RELEASE);
+	if (__atomic_load_n(&hdr->waiters, __ATOMIC_ACQUIRE) > 0) {
+		futex(&hdr->futex, FUTEX_WAKE, INT32_MAX, NULL);
+	}
+}
+
+/* Per consumer counters, returns number of consumers */
+int ows_tap_stats(ows_tap_t *tap, ows_tap_stats_t *stats, int max)
+{
+	tap_hdr_t *hdr = tap->hdr;
+	uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+	tap_consumer_t *pc;
+	int i, n = 0;
+
+	for (i = 0; i < OWS_TAP_MAX_CONSUMERS && n < max; i++) {
+		pc = &hdr->consumer[i];
+		if (pc->pid == 0) {
+			continue;
+		}
+		memcpy(stats[n].name, pc->name, OWS_TAP_NAME_LEN);
+		stats[n].pid = pc->pid;
+		stats[n].lag = head - __atomic_load_n(&pc->pos, __ATOMIC_RELAXED);
+		/* a stalled consumer has not read to update lag_max */
+		stats[n].lag_max = stats[n].lag > pc->lag_max ? stats[n].lag : pc->lag_max;
+		stats[n].overruns = pc->overruns;
+		stats[n].lost = pc->lost;
+		n++;
+	}
+	return(n);
+}
+
+/*
+ * Attach as a consumer, reading starts at the newest audio
+ *  - takes a free slot or one left by a consumer that died
+ */
+ows_tap_t *ows_tap_attach(const char *name)
+{
+	ows_tap_t *tap;
+	tap_hdr_t *hdr;
+	tap_consumer_t *pc;
+	int32_t pid, mypid = getpid();
+	int i;
+
+	tap = tap_map(0);
+	if (tap == NULL) {
+		return(NULL);
+	}
+	hdr = tap->hdr;
+	if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != TAP_MAGIC ||
+	    hdr->version != TAP_VERSION || hdr->frames != OWS_TAP_FRAMES) {
+		printf("%s: no tap broker running\n", __FUNCTION__);
+		ows_tap_close(tap);
+		return(NULL);
+	}
+	for (i = 0; i < OWS_TAP_MAX_CONSUMERS; i++) {
+		pc = &hdr->consumer[i];
+		pid = __atomic_load_n(&pc->pid, __ATOMIC_ACQUIRE);
+		if (pid != 0 && (kill(pid, 0) == 0 || errno != ESRCH)) {
+			continue;
+		}
+		if (__atomic_compare_exchange_n(&pc->pid, &pid, mypid, 0,
+						__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+	}
+	if (i == OWS_TAP_MAX_CONSUMERS) {
+		printf("%s: all %d consumer slots in use\n", __FUNCTION__, OWS_TAP_MAX_CONSUMERS);
+		ows_tap_close(tap);
+		return(NULL);
+	}
+	pc->lag_max = pc->overruns = pc->lost = 0;
+	snprintf(pc->name, OWS_TAP_NAME_LEN, "%s", name);
+	__atomic_store_n(&pc->pos, __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE),
+			 __ATOMIC_RELEASE);
+	tap->me = pc;
+	return(tap);
+}
+
+int ows_tap_rate(ows_tap_t *tap)
+{
+	return(tap->hdr->rate);
+}
+
+/* Frames at pos are safe while the writer's next period can not reach them */
+static int tap_lapped(uint64_t head, uint64_t pos)
+{
+	return(head + OWS_TAP_PERIOD > pos + OWS_TAP_FRAMES);
+}
+
+/*
+ * Wait for audio & point pframes at it, in the ring
+ *  - up to max_frames interleaved frames, valid until ows_tap_release
+ *  - pmono_ns gets the capture time of the first frame
+ *  returns frames available, 0 on timeout
+ */
+int ows_tap_read(ows_tap_t *tap, const int16_t **pframes, int max_frames,
+		 int64_t *pmono_ns, int timeout_ms)
+{
+	tap_hdr_t *hdr = tap->hdr;
+	tap_consumer_t *pc = tap->me;
+	struct timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+	uint64_t head, pos = pc->pos, avail;
+	tap_stamp_t *ps;
+	uint32_t fval;
+
+	while (1) {
+		fval = __atomic_load_n(&hdr->futex, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+		if (tap_lapped(head, pos)) {
+			/* writer went round, skip to the newest audio */
+			pc->overruns++;
+			pc->lost += head - pos;
+			pos = head;
+			__atomic_store_n(&pc->pos, pos, __ATOMIC_RELEASE);
+		}
+		if (head != pos) {
+			break;
+		}
+		if (timeout_ms == 0) {
+			return(0);
+		}
+		__atomic_fetch_add(&hdr->waiters, 1, __ATOMIC_ACQ_REL);
+		if (futex(&hdr->futex, FUTEX_WAIT, fval, timeout_ms < 0 ? NULL : &ts) < 0 &&
+		    errno == ETIMEDOUT) {
+			__atomic_fetch_sub(&hdr->waiters, 1, __ATOMIC_ACQ_REL);
+			return(0);
+		}
+		__atomic_fetch_sub(&hdr->waiters, 1, __ATOMIC_ACQ_REL);
+	}
+
+	avail = head - pos;
+	if (avail > pc->lag_max) {
+		pc->lag_max = avail;
+	}
+	if (avail > (uint64_t)max_frames) {
+		avail = max_frames;
+	}
+	*pframes = (const int16_t *)(tap->data + (pos & TAP_MASK) * TAP_FRAME_BYTES);
+	if (pmono_ns != NULL) {
+		ps = &hdr->stamp[(pos / OWS_TAP_PERIOD) % TAP_NSTAMPS];
+		*pmono_ns = ps->mono_ns +
+			    ((int64_t)(pos - ps->frame) * 1000000000) / (hdr->rate ? hdr->rate : 1);
+	}
+	tap->held = avail;
+	return((int)avail);
+}
+
+/*
+ * Done with nframes from ows_tap_read
+ *  - a lap while the frames were held is counted here & the read
+ *    position skips to the newest audio, as in ows_tap_read
+ *  returns 0, -1 if the writer overwrote them while they were held
+ */
+int ows_tap_release(ows_tap_t *tap, int nframes)
+{
+	tap_consumer_t *pc = tap->me;
+	uint64_t head = __atomic_load_n(&tap->hdr->head, __ATOMIC_ACQUIRE);
+	uint64_t pos = pc->pos;
+	int retcode = 0;
+
+	if ((uint64_t)nframes > tap->held) {
+		nframes = tap->held;
+	}
+	if (tap_lapped(head, pos)) {
+		pc->overruns++;
+		pc->lost += head - pos;
+		retcode = -1;
+	} else {
+		head = pos + nframes;
+	}
+	tap->held = 0;
+	__atomic_store_n(&pc->pos, head, __ATOMIC_RELEASE);
+	return(retcode);
+}
+
+void ows_tap_consumer_stats(ows_tap_t *tap, ows_tap_stats_t *stats)
+{
+	tap_consumer_t *pc = tap->me;
+
+	memcpy(stats->name, pc->name, OWS_TAP_NAME_LEN);
+	stats->pid = pc->pid;
+	stats->lag = __atomic_load_n(&tap->hdr->head, __ATOMIC_ACQUIRE) - pc->pos;
+	stats->lag_max = pc->lag_max;
+	stats->overruns = pc->overruns;
+	stats->lost = pc->lost;
+}
+
+void ows_tap_close(ows_tap_t *tap)
+{
+	if (tap->me != NULL) {
+		__atomic_store_n(&tap->me->pid, 0, __ATOMIC_RELEASE);
+	}
+	if (tap->data != NULL) {
+		munmap(tap->data, 2 * TAP_DATA_BYTES);
+	}
+	munmap(tap->hdr, tap->hdr_size);
+	free(tap);
+}
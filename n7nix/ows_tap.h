@@ -0,0 +1,45 @@
+/*
+ * Shared audio tap, one capture of the UDRC read in place by many
+ * consumers
+ */
+#ifndef OWS_TAP_H
+#define OWS_TAP_H
+
+#include <stdint.h>
+
+/* Shared memory ring name, see shm_open(3) */
+#define OWS_TAP_SHM "/ows_tap"
+#define OWS_TAP_CHANNELS 2
+#define OWS_TAP_FRAMES 131072	/* ring size, power of 2, 2.7 sec at 48 kHz */
+#define OWS_TAP_PERIOD 1024	/* frames per write & per time stamp */
+#define OWS_TAP_MAX_CONSUMERS 8
+#define OWS_TAP_NAME_LEN 16
+
+typedef struct ows_tap ows_tap_t;
+
+typedef struct ows_tap_stats {
+	char name[OWS_TAP_NAME_LEN];
+	int pid;
+	uint64_t lag;		/* frames written but not yet released */
+	uint64_t lag_max;
+	uint64_t overruns;	/* times the writer lapped this consumer */
+	uint64_t lost;		/* frames skipped by overruns */
+} ows_tap_stats_t;
+
+/* Broker, one writer */
+ows_tap_t *ows_tap_create(int rate);
+int16_t *ows_tap_write_ptr(ows_tap_t *tap);
+void ows_tap_commit(ows_tap_t *tap, int nframes, int64_t mono_ns);
+int ows_tap_stats(ows_tap_t *tap, ows_tap_stats_t *stats, int max);
+
+/* Consumers */
+ows_tap_t *ows_tap_attach(const char *name);
+int ows_tap_rate(ows_tap_t *tap);
+int ows_tap_read(ows_tap_t *tap, const int16_t **pframes, int max_frames,
+		 int64_t *pmono_ns, int timeout_ms);
+int ows_tap_release(ows_tap_t *tap, int nframes);
+void ows_tap_consumer_stats(ows_tap_t *tap, ows_tap_stats_t *stats);
+
+void ows_tap_close(ows_tap_t *tap);
+
+#endif /* OWS_TAP_H */
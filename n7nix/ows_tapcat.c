@@ -0,0 +1,282 @@
+/*
+ * Audio tap consumer
+ *  - feeds direwolf from the shared tap through a FIFO or stdout,
+ *    eg. ows_tapcat -c left | direwolf -r 48000 -n 1 -b 16 -
+ *  - or meters level & capture latency in place, no copy
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <time.h>
+#include <signal.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <libgen.h>
+
+#include "ows_tap.h"
+
+#define PROG_VERSION "1.0"
+#define READ_FRAMES 4096	/* max frames handled per read */
+#define METER_SEC 1
+
+enum { CHAN_LEFT, CHAN_RIGHT, CHAN_BOTH };
+
+static void usage(void);
+const char *getprogname(void);
+
+int DebugFlag = false;
+int gverbose_flag = false;
+
+static volatile sig_atomic_t tapcat_done;
+
+static void tapcat_sighandler(int sig)
+{
+	tapcat_done = 1;
+}
+
+extern char *__progname;
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return(-1);
+		}
+		p += n;
+		len -= n;
+	}
+	return(0);
+}
+
+static double db(double x)
+{
+	return(x > 0.0 ? 20.0 * log10(x) : -99.0);
+}
+
+int main(int argc, char *argv[])
+{
+	/* For command line parsing */
+	int next_option;
+	int option_index = 0; /* getopt_long stores the option index here. */
+
+	char *fifo_name = NULL, *consumer_name = NULL, *chan_name = "both";
+	bool meter = false;
+	int chan = CHAN_BOTH, outfd = STDOUT_FILENO;
+	ows_tap_t *tap;
+	ows_tap_stats_t stats;
+	const int16_t *frames;
+	int16_t mono[READ_FRAMES];
+	int64_t mono_ns;
+	double sumsq[2] = { 0.0, 0.0 }, peak[2] = { 0.0, 0.0 };
+	double lat_ms, lat_sum = 0.0, lat_max = 0.0;
+	unsigned long nlat = 0;
+	uint64_t metered = 0;
+	int rate, n, i;
+
+	/* short options */
+	static const char *short_options = "hVdo:c:mn:";
+	/* long options */
+	static struct option long_options[] =
+	{
+		/* These options set a flag. */
+		{"verbose",     no_argument,  &gverbose_flag, true},
+		{"debug",       no_argument,  &DebugFlag, true},
+		/* These options don't set a flag.
+		We distinguish them by their indices. */
+		{"help",        no_argument,       NULL, 'h'},
+		{"output",      required_argument, NULL, 'o'},
+		{"channel",     required_argument, NULL, 'c'},
+		{"meter",       no_argument,       NULL, 'm'},
+		{"name",        required_argument, NULL, 'n'},
+		{NULL, no_argument, NULL, 0} /* array termination */
+	};
+
+	opterr = 0;
+	option_index = 0;
+	next_option = getopt_long (argc, argv, short_options,
+				   long_options, &option_index);
+
+	while( next_option != -1 ) {
+
+		switch (next_option) {
+			case 0:   /* long option without a short arg */
+				break;
+			case 'o': fifo_name = optarg; break;
+			case 'c': chan_name = optarg; break;
+			case 'm': meter = true; break;
+			case 'n': consumer_name = optarg; break;
+			case 'V':   /* set verbose flag */
+				gverbose_flag = true;
+				break;
+			case 'd':
+				DebugFlag = true;
+				break;
+			case 'h':
+				usage();  /* does not return */
+				break;
+			case '?':
+				if (isprint (optopt)) {
+					fprintf (stderr, "%s: Unknown option `-%c'.\n",
+						getprogname(), optopt);
+				} else {
+					fprintf (stderr,"%s: Unknown option character `\\x%x'.\n",
+						getprogname(), optopt);
+				}
+				/* fall through */
+			default:
+				usage();  /* does not return */
+				break;
+		}
+
+		next_option = getopt_long (argc, argv, short_options,
+					   long_options, &option_index);
+	}
+
+	if (strcmp(chan_name, "left") == 0) {
+		chan = CHAN_LEFT;
+	} else if (strcmp(chan_name, "right") == 0) {
+		chan = CHAN_RIGHT;
+	} else if (strcmp(chan_name, "both") == 0) {
+		chan = CHAN_BOTH;
+	} else {
+		printf("Channel must be left, right or both\n");
+		usage();  /* does not return */
+	}
+	if (consumer_name == NULL) {
+		consumer_name = meter ? "meter" : fifo_name != NULL ? basename(fifo_name) : "stdout";
+	}
+
+	if (!meter && fifo_name != NULL) {
+		if (mkfifo(fifo_name, 0644) < 0 && errno != EEXIST) {
+			perror(fifo_name);
+			exit(EXIT_FAILURE);
+		}
+		fprintf(stderr, "Waiting for a reader on %s\n", fifo_name);
+		/* blocks until direwolf opens it */
+		outfd = open(fifo_name, O_WRONLY);
+		if (outfd < 0) {
+			perror(fifo_name);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* attach once the reader is there so it starts with fresh audio */
+	tap = ows_tap_attach(consumer_name);
+	if (tap == NULL) {
+		exit(EXIT_FAILURE);
+	}
+	rate = ows_tap_rate(tap);
+
+	signal(SIGINT, tapcat_sighandler);
+	signal(SIGTERM, tapcat_sighandler);
+	/* reader went away */
+	signal(SIGPIPE, tapcat_sighandler);
+
+	while (!tapcat_done) {
+		n = ows_tap_read(tap, &frames, READ_FRAMES, &mono_ns, 1000);
+		if (n == 0) {
+			continue;
+		}
+		if (meter) {
+			lat_ms = (now_ns() - mono_ns) / 1e6;
+			lat_sum += lat_ms;
+			nlat++;
+			if (lat_ms > lat_max) {
+				lat_max = lat_ms;
+			}
+			for (i = 0; i < n * OWS_TAP_CHANNELS; i++) {
+				double s = frames[i] / 32768.0;
+
+				sumsq[i & 1] += s * s;
+				if (fabs(s) > peak[i & 1]) {
+					peak[i & 1] = fabs(s);
+				}
+			}
+			metered += n;
+			if (metered >= (uint64_t)rate * METER_SEC) {
+				ows_tap_consumer_stats(tap, &stats);
+				printf("L %6.1f dBFS pk %6.1f  R %6.1f dBFS pk %6.1f  latency avg %5.1f ms max %5.1f ms  overruns %llu\n",
+				       db(sqrt(sumsq[0] / metered)), db(peak[0]),
+				       db(sqrt(sumsq[1] / metered)), db(peak[1]),
+				       lat_sum / nlat, lat_max, (unsigned long long)stats.overruns);
+				fflush(stdout);
+				sumsq[0] = sumsq[1] = peak[0] = peak[1] = 0.0;
+				lat_sum = lat_max = 0.0;
+				nlat = 0;
+				metered = 0;
+			}
+		} else if (chan == CHAN_BOTH) {
+			/* straight from the ring */
+			if (write_all(outfd, frames, n * OWS_TAP_CHANNELS * sizeof(int16_t)) < 0) {
+				break;
+			}
+		} else {
+			for (i = 0; i < n; i++) {
+				mono[i] = frames[i * OWS_TAP_CHANNELS + chan];
+			}
+			if (write_all(outfd, mono, n * sizeof(int16_t)) < 0) {
+				break;
+			}
+		}
+		if (ows_tap_release(tap, n) < 0 && gverbose_flag) {
+			fprintf(stderr, "Overrun while writing, audio was overwritten\n");
+		}
+	}
+
+	ows_tap_consumer_stats(tap, &stats);
+	fprintf(stderr, "%s: max lag %.1f ms, %llu overruns, %.1f sec lost\n",
+		consumer_name, 1000.0 * stats.lag_max / rate,
+		(unsigned long long)stats.overruns, (double)stats.lost / rate);
+	ows_tap_close(tap);
+	if (outfd != STDOUT_FILENO) {
+		close(outfd);
+	}
+
+	exit(EXIT_SUCCESS);
+}
+
+const char *getprogname(void)
+{
+	return __progname;
+}
+
+/*
+ * Print usage information and exit
+ *  - does not return
+ */
+static void usage(void)
+{
+	printf("Usage:  %s [options]\n", getprogname());
+	printf("  Version: %s\n", PROG_VERSION);
+	printf("  Reads the shared audio tap %s, run ows_tapd first\n", OWS_TAP_SHM);
+	printf("  -o  --output    Write to this FIFO, created if missing, default stdout\n");
+	printf("  -c  --channel   left, right or both (both)\n");
+	printf("  -m  --meter     Print level & latency instead of writing audio\n");
+	printf("  -n  --name      Consumer name in ows_tapd stats\n");
+	printf("  -V  --verbose   Print verbose messages\n");
+	printf("  -d  --debug     Turn on debug messages\n");
+	printf("  -h  --help      Display this usage info\n");
+
+	exit(EXIT_SUCCESS);
+}
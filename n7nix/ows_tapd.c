@@ -0,0 +1,305 @@
+/*
+ * Audio tap broker
+ *  - captures the UDRC once, straight into the shared ring read by
+ *    ows_tapcat, the scanner DSP & anything else using ows_tap
+ *  - a WAV file can stand in for the sound card, paced in real time
+ *  - reports per consumer lag & overruns
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <time.h>
+#include <signal.h>
+
+#ifdef HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+#include "ows_tap.h"
+#include "ows_wav.h"
+
+#define PROG_VERSION "1.0"
+#define DEFAULT_CAPTURE_DEVICE "plughw:CARD=udrc"
+#define DEFAULT_RATE 48000
+#define DEFAULT_STATS_SEC 10
+
+static void usage(void);
+const char *getprogname(void);
+
+int DebugFlag = false;
+int gverbose_flag = false;
+
+static volatile sig_atomic_t tapd_done;
+
+static void tapd_sighandler(int sig)
+{
+	tapd_done = 1;
+}
+
+extern char *__progname;
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static void print_stats(ows_tap_t *tap, int rate, uint64_t frames)
+{
+	ows_tap_stats_t stats[OWS_TAP_MAX_CONSUMERS];
+	int i, n;
+
+	n = ows_tap_stats(tap, stats, OWS_TAP_MAX_CONSUMERS);
+	printf("Tap: %.1f sec captured, %d consumer%s\n",
+	       (double)frames / rate, n, n == 1 ? "" : "s");
+	for (i = 0; i < n; i++) {
+		printf("  %-15s pid %6d  lag %6.1f ms, max %6.1f ms  overruns %llu, lost %.1f sec\n",
+		       stats[i].name, stats[i].pid,
+		       1000.0 * stats[i].lag / rate, 1000.0 * stats[i].lag_max / rate,
+		       (unsigned long long)stats[i].overruns, (double)stats[i].lost / rate);
+	}
+	fflush(stdout);
+}
+
+/*
+ * WAV file as a fake capture device
+ *  - each period is committed when it would have been captured
+ */
+static uint64_t capture_wav(ows_tap_t *tap, ows_wav_t *pwav, bool loop, int stats_sec)
+{
+	struct timespec next;
+	int64_t t0, t;
+	uint64_t frames = 0, next_stats = (uint64_t)stats_sec * pwav->rate;
+	int16_t *p;
+	int i, n;
+
+	t0 = now_ns();
+	while (!tapd_done) {
+		p = ows_tap_write_ptr(tap);
+		n = ows_wav_read(pwav, p, OWS_TAP_PERIOD);
+		if (n == 0) {
+			if (!loop || ows_wav_rewind(pwav) < 0) {
+				break;
+			}
+			continue;
+		}
+		if (pwav->channels == 1) {
+			/* same audio on both channels, back to front in place */
+			for (i = n - 1; i >= 0; i--) {
+				p[2 * i] = p[2 * i + 1] = p[i];
+			}
+		}
+		/* time the last frame of the period arrives */
+		t = t0 + (int64_t)(frames + n) * 1000000000 / pwav->rate;
+		next.tv_sec = t / 1000000000;
+		next.tv_nsec = t % 1000000000;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR &&
+		       !tapd_done)
+			;
+		ows_tap_commit(tap, n, t0 + (int64_t)frames * 1000000000 / pwav->rate);
+		frames += n;
+		if (stats_sec > 0 && frames >= next_stats) {
+			print_stats(tap, pwav->rate, frames);
+			next_stats += (uint64_t)stats_sec * pwav->rate;
+		}
+	}
+	return(frames);
+}
+
+#ifdef HAVE_ALSA
+static uint64_t capture_alsa(ows_tap_t *tap, const char *device, int rate, int stats_sec)
+{
+	snd_pcm_t *pcm;
+	snd_pcm_sframes_t n, delay;
+	uint64_t frames = 0, next_stats = (uint64_t)stats_sec * rate;
+	int64_t t;
+	int err;
+
+	if ((err = snd_pcm_open(&pcm, device, SND_PCM_STREAM_CAPTURE, 0)) < 0 ||
+	    (err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE,
+				      SND_PCM_ACCESS_RW_INTERLEAVED, OWS_TAP_CHANNELS,
+				      rate, 1, 100000)) < 0) {
+		printf("%s: %s: %s\n", __FUNCTION__, device, snd_strerror(err));
+		return(0);
+	}
+	while (!tapd_done) {
+		n = snd_pcm_readi(pcm, ows_tap_write_ptr(tap), OWS_TAP_PERIOD);
+		if (n < 0) {
+			printf("%s: %s\n", __FUNCTION__, snd_strerror(n));
+			if (snd_pcm_recover(pcm, n, 0) < 0) {
+				break;
+			}
+			continue;
+		}
+		/* first frame was captured delay + n frames ago */
+		t = now_ns();
+		if (snd_pcm_delay(pcm, &delay) < 0) {
+			delay = 0;
+		}
+		t -= (int64_t)(delay + n) * 1000000000 / rate;
+		ows_tap_commit(tap, n, t);
+		frames += n;
+		if (stats_sec > 0 && frames >= next_stats) {
+			print_stats(tap, rate, frames);
+			next_stats += (uint64_t)stats_sec * rate;
+		}
+	}
+	snd_pcm_close(pcm);
+	return(frames);
+}
+#endif /* HAVE_ALSA */
+
+int main(int argc, char *argv[])
+{
+	/* For command line parsing */
+	int next_option;
+	int option_index = 0; /* getopt_long stores the option index here. */
+
+	char *capture_device = DEFAULT_CAPTURE_DEVICE;
+	char *wav_file = NULL;
+	int rate = DEFAULT_RATE, stats_sec = DEFAULT_STATS_SEC;
+	bool loop = false;
+	ows_tap_t *tap;
+	ows_wav_t wav;
+	uint64_t frames;
+
+	/* short options */
+	static const char *short_options = "hVdD:f:Lr:i:";
+	/* long options */
+	static struct option long_options[] =
+	{
+		/* These options set a flag. */
+		{"verbose",     no_argument,  &gverbose_flag, true},
+		{"debug",       no_argument,  &DebugFlag, true},
+		/* These options don't set a flag.
+		We distinguish them by their indices. */
+		{"help",        no_argument,       NULL, 'h'},
+		{"device",      required_argument, NULL, 'D'},
+		{"file",        required_argument, NULL, 'f'},
+		{"loop",        no_argument,       NULL, 'L'},
+		{"rate",        required_argument, NULL, 'r'},
+		{"interval",    required_argument, NULL, 'i'},
+		{NULL, no_argument, NULL, 0} /* array termination */
+	};
+
+	opterr = 0;
+	option_index = 0;
+	next_option = getopt_long (argc, argv, short_options,
+				   long_options, &option_index);
+
+	while( next_option != -1 ) {
+
+		switch (next_option) {
+			case 0:   /* long option without a short arg */
+				break;
+			case 'D': capture_device = optarg; break;
+			case 'f': wav_file = optarg; break;
+			case 'L': loop = true; break;
+			case 'r': rate = atoi(optarg); break;
+			case 'i': stats_sec = atoi(optarg); break;
+			case 'V':   /* set verbose flag */
+				gverbose_flag = true;
+				break;
+			case 'd':
+				DebugFlag = true;
+				break;
+			case 'h':
+				usage();  /* does not return */
+				break;
+			case '?':
+				if (isprint (optopt)) {
+					fprintf (stderr, "%s: Unknown option `-%c'.\n",
+						getprogname(), optopt);
+				} else {
+					fprintf (stderr,"%s: Unknown option character `\\x%x'.\n",
+						getprogname(), optopt);
+				}
+				/* fall through */
+			default:
+				usage();  /* does not return */
+				break;
+		}
+
+		next_option = getopt_long (argc, argv, short_options,
+					   long_options, &option_index);
+	}
+
+	if (wav_file != NULL) {
+		if (ows_wav_open(wav_file, &wav) < 0) {
+			exit(EXIT_FAILURE);
+		}
+		if (wav.channels < 1 || wav.channels > OWS_TAP_CHANNELS) {
+			printf("%s: %d channels, tap carries %d\n",
+			       wav_file, wav.channels, OWS_TAP_CHANNELS);
+			exit(EXIT_FAILURE);
+		}
+		if (wav.rate <= 0) {
+			printf("%s: sample rate %d\n", wav_file, wav.rate);
+			exit(EXIT_FAILURE);
+		}
+		rate = wav.rate;
+	}
+
+	tap = ows_tap_create(rate);
+	if (tap == NULL) {
+		exit(EXIT_FAILURE);
+	}
+	signal(SIGINT, tapd_sighandler);
+	signal(SIGTERM, tapd_sighandler);
+
+	printf("Tap %s: %d Hz, %d channels, ring %.2f sec, period %.1f ms, from %s\n",
+	       OWS_TAP_SHM, rate, OWS_TAP_CHANNELS, (double)OWS_TAP_FRAMES / rate,
+	       1000.0 * OWS_TAP_PERIOD / rate, wav_file != NULL ? wav_file : capture_device);
+	fflush(stdout);
+
+	if (wav_file != NULL) {
+		frames = capture_wav(tap, &wav, loop, stats_sec);
+		ows_wav_close(&wav);
+	} else {
+#ifdef HAVE_ALSA
+		frames = capture_alsa(tap, capture_device, rate, stats_sec);
+#else
+		printf("Built without ALSA, use --file\n");
+		frames = 0;
+#endif
+	}
+	print_stats(tap, rate, frames);
+
+	/* ring stays for consumers & the next broker */
+	ows_tap_close(tap);
+
+	exit(frames > 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+const char *getprogname(void)
+{
+	return __progname;
+}
+
+/*
+ * Print usage information and exit
+ *  - does not return
+ */
+static void usage(void)
+{
+	printf("Usage:  %s [options]\n", getprogname());
+	printf("  Version: %s\n", PROG_VERSION);
+	printf("  Captures audio once into the shared tap %s\n", OWS_TAP_SHM);
+	printf("  -D  --device    ALSA capture device (%s)\n", DEFAULT_CAPTURE_DEVICE);
+	printf("  -f  --file      Read a 16 bit WAV file instead of capturing\n");
+	printf("  -L  --loop      Repeat the WAV file until ctrl-c\n");
+	printf("  -r  --rate      Capture sample rate (%d)\n", DEFAULT_RATE);
+	printf("  -i  --interval  Consumer stats every this many sec, 0 off (%d)\n", DEFAULT_STATS_SEC);
+	printf("  -V  --verbose   Print verbose messages\n");
+	printf("  -d  --debug     Turn on debug messages\n");
+	printf("  -h  --help      Display this usage info\n");
+
+	exit(EXIT_SUCCESS);
+}
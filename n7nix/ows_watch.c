@@ -0,0 +1,386 @@
+/*
+ * Duty cycled watch of the configured receive frequency
+ *  - powers the DRA818V down with the GPIO 24 Activate line between
+ *    listens & replays the configuration cached by ows_init on wake
+ *  - measures wake to ready time & sizes the sleep so a signal is
+ *    seen within the target latency
+ *  - stays awake while the channel is busy
+ *  - estimates energy saved & packets missed against always on
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <time.h>
+#include <signal.h>
+
+#include "ows_serialio.h"
+#include "ows_module.h"
+#include "ows_gpio.h"
+
+#define PROG_VERSION "1.0"
+/* Links to: /dev/ttyAMA0 on RPi 2, /dev/ttyS0 on RPi 3 */
+#define RPI_SERIAL_DEVICE "/dev/serial0"
+#define SIZE_READBUF 128
+#define SIZE_ATBUF 128
+
+#define DEFAULT_TARGET_MS 5000	/* max time from signal to detect */
+#define DEFAULT_LISTEN_MS 200	/* time awake listening each cycle */
+#define DEFAULT_HOLD_MS 3000	/* stay awake after channel goes quiet */
+#define DEFAULT_SAMPLE_MS 50	/* S+ sample period while awake */
+#define DEFAULT_PACKET_MS 600	/* 1200 baud APRS packet with preamble */
+#define PROBE_MS 100		/* handshake timeout while waiting for ready, > reply time */
+#define WAKE_MAX_MS 2000	/* give up on a wake after this long */
+#define WAKE_HISTORY 16		/* cycles of wake time used to size the sleep */
+/* Module current, typical figures, measure your own with -I & -i */
+#define DEFAULT_RX_MA 60.0
+#define DEFAULT_SLEEP_MA 0.1
+
+static void usage(void);
+const char *getprogname(void);
+
+int DebugFlag = false;
+int gverbose_flag = false;
+
+static volatile sig_atomic_t watch_done;
+
+static void watch_sighandler(int sig)
+{
+	watch_done = 1;
+}
+
+extern char *__progname;
+
+static struct {
+	unsigned long cycles;
+	unsigned long wake_fails;
+	unsigned long heard;
+	double wake_ms_sum;
+	double wake_ms_max;
+	double awake_ms;	/* Activate line high */
+	double asleep_ms;
+	double listen_ms;	/* awake & configured */
+	double miss_window_ms;	/* off time a whole packet can hide in */
+} stats;
+
+static double rx_ma = DEFAULT_RX_MA, sleep_ma = DEFAULT_SLEEP_MA;
+static int packet_ms = DEFAULT_PACKET_MS;
+
+/*
+ * Receive frequency from the cached AT+DMOSETGROUP, 3rd field
+ */
+static int cached_rx_freq(char *freq, int len)
+{
+	const char *group = ows_state_get("AT+DMOSETGROUP");
+	int i;
+
+	if (group == NULL) {
+		return(-1);
+	}
+	for (i = 0; i < 2 && group != NULL; i++) {
+		group = strchr(group + 1, ',');
+	}
+	if (group == NULL) {
+		return(-1);
+	}
+	group++;
+	snprintf(freq, len, "%.*s", (int)strcspn(group, ","), group);
+	return(0);
+}
+
+/* One S+ sample, returns 1 busy, 0 quiet, -1 no reply */
+static int sample(int fd, const char *atbuf)
+{
+	char readbuf[SIZE_READBUF];
+	int retcode;
+
+	retcode = ows_module_command(fd, (char *)atbuf, readbuf, sizeof(readbuf));
+	if (retcode <= 0) {
+		return(-1);
+	}
+	return(atoi(&readbuf[2]) != 1);
+}
+
+static void watch_report(void)
+{
+	double total_ms = stats.awake_ms + stats.asleep_ms;
+	double used, always_on, rate, missed;
+
+	if (stats.cycles == 0 || total_ms <= 0.0) {
+		return;
+	}
+	/* mAh */
+	used = (stats.awake_ms * rx_ma + stats.asleep_ms * sleep_ma) / 3600000.0;
+	always_on = total_ms * rx_ma / 3600000.0;
+	/* packet rate seen while listening, assumed the same while asleep */
+	rate = stats.listen_ms > 0.0 ? stats.heard / stats.listen_ms : 0.0;
+	missed = rate * stats.miss_window_ms;
+
+	printf("Watch: %lu cycles in %.1f sec, awake %.1f%%, %lu failed wakes\n",
+	       stats.cycles, total_ms / 1000.0, 100.0 * stats.awake_ms / total_ms,
+	       stats.wake_fails);
+	printf("  wake to ready: avg %.0f ms, max %.0f ms\n",
+	       stats.wake_ms_sum / (stats.cycles - stats.wake_fails > 0 ?
+				     stats.cycles - stats.wake_fails : 1),
+	       stats.wake_ms_max);
+	printf("  energy: %.3f mAh, always on %.3f mAh, saved %.1f%%\n",
+	       used, always_on, 100.0 * (always_on - used) / always_on);
+	printf("  packets: %lu heard, %.1f estimated missed (%.1f%%)\n",
+	       stats.heard, missed,
+	       stats.heard + missed > 0.0 ? 100.0 * missed / (stats.heard + missed) : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+	/* For command line parsing */
+	int next_option;
+	int option_index = 0; /* getopt_long stores the option index here. */
+
+	int uart0fs;
+	char atbuf[SIZE_ATBUF], freq[16];
+	char *serial_device = RPI_SERIAL_DEVICE;
+	int target_ms = DEFAULT_TARGET_MS, listen_ms = DEFAULT_LISTEN_MS;
+	int hold_ms = DEFAULT_HOLD_MS, sample_ms = DEFAULT_SAMPLE_MS;
+	int run_sec = 0;
+	double wake_hist[WAKE_HISTORY];
+	double t_start, t_wake, t_ready, t_quiet, t_sleep = 0.0, now, wake_ms, wake_est, sleep_ms;
+	double off_ms = 0.0;
+	bool busy, powered = true;
+	int sig, i, nhist = 0;
+
+	/* short options */
+	static const char *short_options = "hVdD:L:l:H:s:p:I:i:T:";
+	/* long options */
+	static struct option long_options[] =
+	{
+		/* These options set a flag. */
+		{"verbose",     no_argument,  &gverbose_flag, true},
+		{"debug",       no_argument,  &DebugFlag, true},
+		/* These options don't set a flag.
+		We distinguish them by their indices. */
+		{"help",        no_argument,       NULL, 'h'},
+		{"device",      required_argument, NULL, 'D'},
+		{"latency",     required_argument, NULL, 'L'},
+		{"listen",      required_argument, NULL, 'l'},
+		{"hold",        required_argument, NULL, 'H'},
+		{"sample",      required_argument, NULL, 's'},
+		{"packet",      required_argument, NULL, 'p'},
+		{"rx-ma",       required_argument, NULL, 'I'},
+		{"sleep-ma",    required_argument, NULL, 'i'},
+		{"time",        required_argument, NULL, 'T'},
+		{NULL, no_argument, NULL, 0} /* array termination */
+	};
+
+	opterr = 0;
+	option_index = 0;
+	next_option = getopt_long (argc, argv, short_options,
+				   long_options, &option_index);
+
+	while( next_option != -1 ) {
+
+		switch (next_option) {
+			case 0:   /* long option without a short arg */
+				break;
+			case 'D': serial_device = optarg; break;
+			case 'L': target_ms = atoi(optarg); break;
+			case 'l': listen_ms = atoi(optarg); break;
+			case 'H': hold_ms = atoi(optarg); break;
+			case 's': sample_ms = atoi(optarg); break;
+			case 'p': packet_ms = atoi(optarg); break;
+			case 'I': rx_ma = atof(optarg); break;
+			case 'i': sleep_ma = atof(optarg); break;
+			case 'T': run_sec = atoi(optarg); break;
+			case 'V':   /* set verbose flag */
+				gverbose_flag = true;
+				break;
+			case 'd':
+				DebugFlag = true;
+				break;
+			case 'h':
+				usage();  /* does not return */
+				break;
+			case '?':
+				if (isprint (optopt)) {
+					fprintf (stderr, "%s: Unknown option `-%c'.\n",
+						getprogname(), optopt);
+				} else {
+					fprintf (stderr,"%s: Unknown option character `\\x%x'.\n",
+						getprogname(), optopt);
+				}
+				/* fall through */
+			default:
+				usage();  /* does not return */
+				break;
+		}
+
+		next_option = getopt_long (argc, argv, short_options,
+					   long_options, &option_index);
+	}
+
+	if (ows_state_load(OWS_STATE_FILE) <= 0 ||
+	    cached_rx_freq(freq, sizeof(freq)) < 0) {
+		printf("No cached configuration in %s, run ows_init first\n", OWS_STATE_FILE);
+		exit(EXIT_FAILURE);
+	}
+	snprintf(atbuf, sizeof(atbuf), "S+%s", freq);
+
+	uart0fs = ows_initserial(serial_device);
+	if (uart0fs == -1) {
+		exit(EXIT_FAILURE);
+	}
+	if (ows_gpio_open() < 0 ||
+	    ows_gpio_output(OWS_GPIO_ACTIVATE, 1) < 0) {
+		printf("Can not control module Activate line\n");
+		exit(EXIT_FAILURE);
+	}
+	/* short timeout so ready is seen soon after the module boots */
+	ows_setreadtimeout(PROBE_MS);
+
+	signal(SIGINT, watch_sighandler);
+	signal(SIGTERM, watch_sighandler);
+
+	printf("Watching %s, target latency %d ms, listen %d ms, hold %d ms\n",
+	       freq, target_ms, listen_ms, hold_ms);
+
+	t_start = ows_module_now_ms();
+	wake_est = 0.0;
+	while (!watch_done) {
+		/* wake & restore configuration */
+		t_wake = ows_module_now_ms();
+		if (!powered) {
+			stats.asleep_ms += t_wake - t_sleep;
+		}
+		if (ows_module_wake(uart0fs, WAKE_MAX_MS / PROBE_MS) < 0) {
+			stats.wake_fails++;
+			stats.cycles++;
+			printf("Module did not wake in %d ms\n", WAKE_MAX_MS);
+			t_ready = ows_module_now_ms();
+			stats.awake_ms += t_ready - t_wake;
+			powered = true;
+			continue;
+		}
+		powered = true;
+		t_ready = ows_module_now_ms();
+		wake_ms = t_ready - t_wake;
+		stats.cycles++;
+		stats.wake_ms_sum += wake_ms;
+		if (wake_ms > stats.wake_ms_max) {
+			stats.wake_ms_max = wake_ms;
+		}
+		/* a packet shorter than the time off was missed if it fell inside */
+		if (off_ms > 0.0) {
+			off_ms += wake_ms;
+			if (off_ms > packet_ms) {
+				stats.miss_window_ms += off_ms - packet_ms;
+			}
+		}
+
+		/* worst recent wake sizes the next sleep */
+		wake_hist[nhist++ % WAKE_HISTORY] = wake_ms;
+		wake_est = 0.0;
+		for (i = 0; i < WAKE_HISTORY && i < nhist; i++) {
+			if (wake_hist[i] > wake_est) {
+				wake_est = wake_hist[i];
+			}
+		}
+
+		/* listen, stay awake while the channel is busy */
+		busy = false;
+		t_quiet = t_ready - hold_ms;
+		now = t_ready;
+		while (!watch_done && (now - t_ready < listen_ms || now - t_quiet < hold_ms)) {
+			sig = sample(uart0fs, atbuf);
+			now = ows_module_now_ms();
+			if (sig < 0) {
+				break;
+			}
+			if (sig) {
+				if (!busy) {
+					stats.heard++;
+					printf("signal on %s after %.0f ms awake\n", freq, now - t_wake);
+				}
+				busy = true;
+				t_quiet = now;
+			} else {
+				if (busy && gverbose_flag) {
+					printf("clear on %s\n", freq);
+				}
+				busy = false;
+			}
+			ows_module_sleep_ms(sample_ms);
+			now = ows_module_now_ms();
+		}
+		stats.listen_ms += now - t_ready;
+		stats.awake_ms += now - t_wake;
+		if (watch_done ||
+		    (run_sec > 0 && now - t_start >= run_sec * 1000.0)) {
+			break;
+		}
+
+		/* sleep so a signal starting now is seen within the target */
+		sleep_ms = target_ms - wake_est - sample_ms;
+		if (sleep_ms <= 0.0) {
+			if (gverbose_flag) {
+				printf("wake %.0f ms leaves no time to sleep\n", wake_est);
+			}
+			off_ms = 0.0;
+			continue;
+		}
+		if (gverbose_flag) {
+			printf("cycle %lu: wake %.0f ms, sleep %.0f ms\n",
+			       stats.cycles, wake_ms, sleep_ms);
+		}
+		ows_module_powerdown();
+		powered = false;
+		t_sleep = ows_module_now_ms();
+		ows_module_sleep_ms((int)sleep_ms);
+		off_ms = sleep_ms;
+	}
+
+	/* leave the module on & configured for ows_scan */
+	if (!powered) {
+		ows_module_wake(uart0fs, WAKE_MAX_MS / PROBE_MS);
+	}
+	watch_report();
+	close(uart0fs);
+	/* Activate must stay set once we exit */
+	if (ows_gpio_keep() < 0) {
+		exit(EXIT_FAILURE);
+	}
+
+	return(0);
+}
+
+const char *getprogname(void)
+{
+	return __progname;
+}
+
+/*
+ * Print usage information and exit
+ *  - does not return
+ */
+static void usage(void)
+{
+	printf("Usage:  %s [options]\n", getprogname());
+	printf("  Version: %s\n", PROG_VERSION);
+	printf("  Watches the frequency configured by ows_init\n");
+	printf("  -L  --latency   Max time from signal to detect in ms (%d)\n", DEFAULT_TARGET_MS);
+	printf("  -l  --listen    Time to listen each wake in ms (%d)\n", DEFAULT_LISTEN_MS);
+	printf("  -H  --hold      Stay awake this long after a signal in ms (%d)\n", DEFAULT_HOLD_MS);
+	printf("  -s  --sample    Time between samples while awake in ms (%d)\n", DEFAULT_SAMPLE_MS);
+	printf("  -p  --packet    Packet length for the missed estimate in ms (%d)\n", DEFAULT_PACKET_MS);
+	printf("  -I  --rx-ma     Module receive current in mA (%.1f)\n", DEFAULT_RX_MA);
+	printf("  -i  --sleep-ma  Module powered down current in mA (%.1f)\n", DEFAULT_SLEEP_MA);
+	printf("  -T  --time      Stop after this many sec, default run until ctrl-c\n");
+	printf("  -D  --device    Serial device (%s)\n", RPI_SERIAL_DEVICE);
+	printf("  -V  --verbose   Print verbose messages\n");
+	printf("  -d  --debug     Turn on debug messages\n");
+	printf("  -h  --help      Display this usage info\n");
+
+	exit(EXIT_SUCCESS);
+}
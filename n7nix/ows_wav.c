@@ -0,0 +1,100 @@
+/*
+ * 16 bit PCM WAV file reader, used for recorded test audio
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "ows_wav.h"
+
+int ows_wav_open(const char *pathname, ows_wav_t *pwav)
+{
+	char id[4];
+	uint32_t size;
+	uint16_t fmt[8];
+	bool have_fmt = false;
+
+	memset(pwav, 0, sizeof(*pwav));
+	pwav->fp = fopen(pathname, "rb");
+	if (pwav->fp == NULL) {
+		perror(pathname);
+		return(-1);
+	}
+	if (fread(id, 4, 1, pwav->fp) != 1 || memcmp(id, "RIFF", 4) != 0 ||
+	    fread(&size, 4, 1, pwav->fp) != 1 ||
+	    fread(id, 4, 1, pwav->fp) != 1 || memcmp(id, "WAVE", 4) != 0) {
+		printf("%s: %s is not a WAV file\n", __FUNCTION__, pathname);
+		fclose(pwav->fp);
+		return(-1);
+	}
+	while (fread(id, 4, 1, pwav->fp) == 1 && fread(&size, 4, 1, pwav->fp) == 1) {
+		if (memcmp(id, "fmt ", 4) == 0 && size >= 16) {
+			if (fread(fmt, 16, 1, pwav->fp) != 1) {
+				break;
+			}
+			fseek(pwav->fp, size - 16 + (size & 1), SEEK_CUR);
+			/* format tag 1 is PCM, bits per sample in fmt[7] */
+			if (fmt[0] != 1 || fmt[7] != 16) {
+				printf("%s: only 16 bit PCM WAV files\n", __FUNCTION__);
+				break;
+			}
+			pwav->channels = fmt[1];
+			pwav->rate = fmt[2] | (fmt[3] << 16);
+			if (pwav->channels < 1 || pwav->channels > OWS_WAV_MAX_CHANNELS) {
+				printf("%s: %s has %d channels, 1 to %d supported\n",
+				       __FUNCTION__, pathname, pwav->channels, OWS_WAV_MAX_CHANNELS);
+				fclose(pwav->fp);
+				return(-1);
+			}
+			if (pwav->rate < OWS_WAV_MIN_RATE) {
+				printf("%s: %s sample rate %d, below %d\n",
+				       __FUNCTION__, pathname, pwav->rate, OWS_WAV_MIN_RATE);
+				fclose(pwav->fp);
+				return(-1);
+			}
+			have_fmt = true;
+		} else if (memcmp(id, "data", 4) == 0 && have_fmt) {
+			pwav->data_start = ftell(pwav->fp);
+			pwav->data_size = pwav->data_left = size;
+			return(0);
+		} else {
+			fseek(pwav->fp, size + (size & 1), SEEK_CUR);
+		}
+	}
+	printf("%s: %s has no PCM data\n", __FUNCTION__, pathname);
+	fclose(pwav->fp);
+	return(-1);
+}
+
+/*
+ * Read up to maxframes interleaved frames
+ *  returns frames read, 0 at end of data
+ */
+int ows_wav_read(ows_wav_t *pwav, int16_t *frames, int maxframes)
+{
+	int framesize = 2 * pwav->channels;
+	int nframes;
+
+	nframes = pwav->data_left / framesize;
+	if (nframes > maxframes) {
+		nframes = maxframes;
+	}
+	nframes = fread(frames, framesize, nframes, pwav->fp);
+	pwav->data_left -= nframes * framesize;
+	return(nframes);
+}
+
+int ows_wav_rewind(ows_wav_t *pwav)
+{
+	pwav->data_left = pwav->data_size;
+	return(fseek(pwav->fp, pwav->data_start, SEEK_SET));
+}
+
+void ows_wav_close(ows_wav_t *pwav)
+{
+	if (pwav->fp != NULL) {
+		fclose(pwav->fp);
+		pwav->fp = NULL;
+	}
+}
@@ -0,0 +1,27 @@
+/*
+ * 16 bit PCM WAV file reader
+ */
+#ifndef OWS_WAV_H
+#define OWS_WAV_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define OWS_WAV_MAX_CHANNELS 2	/* UDRC is stereo */
+#define OWS_WAV_MIN_RATE 8000	/* 3 kHz audio band under Nyquist */
+
+typedef struct ows_wav {
+	FILE *fp;
+	int channels;
+	int rate;
+	long data_start;	/* file offset of first frame */
+	uint32_t data_size;	/* bytes */
+	uint32_t data_left;
+} ows_wav_t;
+
+int ows_wav_open(const char *pathname, ows_wav_t *pwav);
+int ows_wav_read(ows_wav_t *pwav, int16_t *frames, int maxframes);
+int ows_wav_rewind(ows_wav_t *pwav);
+void ows_wav_close(ows_wav_t *pwav);
+
+#endif /* OWS_WAV_H */